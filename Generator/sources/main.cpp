@@ -1,99 +1,456 @@
-#include <iostream>
-#include <fstream>
-#include <string_view>
-#include <string>
-#include <unordered_map>
-#include <unordered_set>
-#include <vector>
-#include <format>
-#include <cctype>
-#include <random>
-#include <algorithm>
-
-auto trim_file(std::string w) 
-{
-  auto begin = w.find_first_not_of(' ');
-  auto end = w.find_last_not_of(' ');
-  return w.substr(begin, end - begin);
-}
-
-auto filter_string(std::string_view sv)
-{
-  std::string tmp;
-  tmp.reserve(sv.size());
-  for (auto&& c : sv) {
-    if (!isalpha(c))
-      continue;
-    tmp.push_back(tolower(c));
-  }
-  return tmp;
-}
-
-int main(int, char**)
-{
-  using namespace std;
-  using namespace string_literals;
-  using namespace string_view_literals;
-  
-  unordered_set<string> word_set;
-  vector<string> word_table;
-
-  ifstream wordlist_file ("words.txt");
-  string word;
-
-  while (getline(wordlist_file, word))
-  {
-    word = filter_string(word);
-    if (word.empty())
-      continue;
-    auto[it, success] = word_set.emplace(word);
-    if (!success) 
-      continue;
-    //cout << "\"" << word << "\"\n";
-  }
-  word_table.reserve(word_set.size());  
-  for (auto it = word_set.begin(); it != word_set.end(); )
-    word_table.emplace_back(std::move(word_set.extract(it++).value()));
-
-  random_device rd;
-  mt19937_64 mt_rand{ rd() };
-  auto wt_part_size = (word_table.size() + 63) / 64;
-  uniform_int_distribution<unsigned long long> rand_word{ 0, wt_part_size - 1 };
-
-  cout << "Building from " << word_table.size() << " words...\n";
-  
-  ofstream test_file("test_case.txt", ios::binary);
-
-  uint64_t size_so_far  { 0 };
-                        //0x800000000ull
-  uint64_t target_size  { 0x40000000ull  };
-  uint64_t stat_update  { 0 };
-
-  while (size_so_far < target_size)
-  {
-    auto j = size_so_far / (16 * 1024 * 1024);
-    auto word = word_table.at((wt_part_size * j + rand_word(mt_rand)) % word_table.size());
-
-    auto space = "                "sv.substr(0, 1 + (mt_rand() & 0x1));
-    size_so_far += (space.size() + word.size());
-    stat_update += (space.size() + word.size());
-
-    test_file << word;
-    test_file << space;
-
-    word_set.emplace(std::move (word));
-
-    if (stat_update > 1024 * 1024)
-    {
-      shuffle(word_table.begin(), word_table.end(), mt_rand);
-      stat_update = 0;
-      cout << "Progress so far : " << size_so_far << " | " << (int)((size_so_far * 100.0) / target_size) << " % | words used : " << word_set.size() << "\r";
-    }
-
-  }
-  
-  
-  
-
-  return 0;
-}
\ No newline at end of file
+#include <bit>
+#include <cmath>
+#include <numeric>
+#include <deque>
+#include <future>
+#include <random>
+#include <string>
+#include <vector>
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include "file_wrapper.hpp"
+#include "program_args.hpp"
+#include "parallel_task_dispatch.hpp"
+
+// Writes a test corpus of space separated words made up from a built-in
+// synthetic vocabulary. The output is cut into fixed size blocks, each one is
+// generated by a worker from its own random stream seeded by (seed, block index)
+// and written at its precomputed offset, so the file only depends on the
+// options and never on the number of threads. Every word of the vocabulary
+// appears at least once, the number of distinct words (counted, not assumed)
+// is written to <output>.expected next to it.
+
+enum class distribution_type
+{
+  uniform,
+  zipf
+};
+
+struct generator_options
+{
+  std::filesystem::path output_path { "test_case.txt" };
+  std::uint64_t         target_size { 1024ull*1024ull*1024ull };
+  std::uint64_t         block_size { 8u*1024u*1024u };
+  std::uint64_t         vocabulary_size { 1000000u };
+  std::uint64_t         seed { 1u };
+  std::size_t           num_threads { 0u };
+  distribution_type     distribution { distribution_type::uniform };
+  double                zipf_exponent { 1.0 };
+};
+
+auto args_parse_generator_options(std::vector<std::string_view> args)
+  -> generator_options
+{
+  using namespace std;
+  generator_options options;
+  vector<std::string_view> positional;
+
+  for (std::size_t i = 1u; i < args.size(); ++i)
+  {
+    const auto arg = args[i];
+    if (!arg.starts_with("--"))
+      positional.push_back(arg);
+    else if (const auto value = args_option_value(args, i, "--size"))
+      options.target_size = args_parse_size(*value);
+    else if (const auto value = args_option_value(args, i, "--block-size"))
+      options.block_size = args_parse_size(*value);
+    else if (const auto value = args_option_value(args, i, "--unique"))
+      options.vocabulary_size = args_parse_size(*value);
+    else if (const auto value = args_option_value(args, i, "--seed"))
+      options.seed = args_parse_size(*value);
+    else if (const auto value = args_option_value(args, i, "--threads"))
+      options.num_threads = args_parse_size(*value);
+    else if (const auto value = args_option_value(args, i, "--zipf-exponent"))
+      options.zipf_exponent = std::stod(std::string { *value });
+    else if (const auto name = args_option_value(args, i, "--distribution"))
+    {
+      if (*name == "uniform")
+        options.distribution = distribution_type::uniform;
+      else if (*name == "zipf")
+        options.distribution = distribution_type::zipf;
+      else
+        throw runtime_error(fmt::format("Unknown distribution '{}'", *name));
+    }
+    else
+      throw runtime_error(fmt::format("Unknown option '{}'", arg));
+  }
+  if (positional.size() > 1u)
+    throw runtime_error("Only one output file can be given");
+  if (!positional.empty())
+    options.output_path = positional.front();
+  if (options.vocabulary_size < 1u)
+    throw runtime_error("--unique must be at least 1");
+  if (options.block_size < 64u)
+    throw runtime_error("--block-size must be at least 64 bytes");
+  if (options.zipf_exponent <= 0.0)
+    throw runtime_error("Zipf exponent must be positive");
+  return options;
+}
+
+constexpr auto splitmix64(std::uint64_t value) noexcept
+  -> std::uint64_t
+{
+  value += 0x9e3779b97f4a7c15ull;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+  return value ^ (value >> 31);
+}
+
+// Word number index of the vocabulary : a letter giving the count of base 26
+// digits, the digits of the index, then pseudo random letters up to a length
+// drawn from the seed. The leading part decodes back to the index, so all the
+// words of the vocabulary are distinct.
+struct synthetic_vocabulary
+{
+  static constexpr std::size_t max_word_length = 24u;
+
+  synthetic_vocabulary(std::uint64_t size, std::uint64_t seed)
+  : m_size { size },
+    m_seed { splitmix64(seed ^ 0x5851f42d4c957f2dull) }
+  {}
+
+  auto size() const noexcept -> std::uint64_t { return m_size; }
+
+  auto length(std::uint64_t index) const noexcept
+    -> std::size_t
+  {
+    std::size_t num_digits { 1u };
+    for (auto value = index / 26u; value != 0u; value /= 26u)
+      ++num_digits;
+
+    const auto bits = splitmix64(m_seed ^ index);
+    // Lengths mostly between 3 and 12, with an occasional long word.
+    auto length = std::size_t { 3u + (bits & 0x7u) + ((bits >> 3) & 0x3u) };
+    if (((bits >> 5) & 0x1fu) == 0u)
+      length += 8u + ((bits >> 10) & 0x3u);
+    return std::clamp<std::size_t> (length, num_digits + 1u, max_word_length);
+  }
+
+  auto word(std::uint64_t index, char* output) const noexcept
+    -> std::size_t
+  {
+    char digits [16];
+    std::size_t num_digits { 0u };
+    auto value = index;
+    do {
+      digits[num_digits++] = char('a' + value % 26u);
+      value /= 26u;
+    } while (value != 0u);
+
+    const auto length = this->length(index);
+    output[0] = char('a' + num_digits - 1u);
+    std::copy_n(digits, num_digits, output + 1u);
+    auto bits = splitmix64(m_seed ^ index);
+    for (auto i = num_digits + 1u; i < length; ++i)
+    {
+      bits = splitmix64(bits);
+      output[i] = char('a' + bits % 26u);
+    }
+    return length;
+  }
+
+private:
+  std::uint64_t m_size;
+  std::uint64_t m_seed;
+};
+
+// Zipf distribution over [0, size) by rejection-inversion (Hormann & Derflinger),
+// constant time and memory whatever the vocabulary size.
+struct zipf_distribution
+{
+  zipf_distribution(std::uint64_t size, double exponent)
+  : m_size { double(size) },
+    m_exponent { exponent },
+    m_h_integral_x1 { h_integral(1.5) - 1.0 },
+    m_h_integral_n { h_integral(m_size + 0.5) },
+    m_s { 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0)) }
+  {}
+
+  template <typename _Generator>
+  auto operator () (_Generator& generator) const
+    -> std::uint64_t
+  {
+    std::uniform_real_distribution<double> uniform { 0.0, 1.0 };
+    for (;;)
+    {
+      const auto u = m_h_integral_n + uniform(generator) * (m_h_integral_x1 - m_h_integral_n);
+      const auto x = h_integral_inverse(u);
+      const auto k = std::clamp(std::floor(x + 0.5), 1.0, m_size);
+      if (k - x <= m_s || u >= h_integral(k + 0.5) - h(k))
+        return std::uint64_t (k) - 1u;
+    }
+  }
+
+private:
+  auto h(double x) const -> double
+  {
+    return std::exp(-m_exponent * std::log(x));
+  }
+
+  auto h_integral(double x) const -> double
+  {
+    const auto log_x = std::log(x);
+    return helper2((1.0 - m_exponent) * log_x) * log_x;
+  }
+
+  auto h_integral_inverse(double x) const -> double
+  {
+    auto t = x * (1.0 - m_exponent);
+    if (t < -1.0)
+      t = -1.0;
+    return std::exp(helper1(t) * x);
+  }
+
+  static auto helper1(double x) -> double
+  {
+    return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+  }
+
+  static auto helper2(double x) -> double
+  {
+    return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+  }
+
+  double m_size;
+  double m_exponent;
+  double m_h_integral_x1;
+  double m_h_integral_n;
+  double m_s;
+};
+
+struct block_generator
+{
+  block_generator(const generator_options& options, std::size_t num_workers)
+  : m_options { options },
+    m_vocabulary { options.vocabulary_size, options.seed },
+    m_zipf { options.vocabulary_size, options.zipf_exponent },
+    m_used_words (num_workers),
+    m_stride { coprime_stride(options.vocabulary_size, options.seed) },
+    m_shift { splitmix64(options.seed ^ 0x2545f4914f6cdd1dull) % options.vocabulary_size }
+  {}
+
+  // Fills the whole buffer, words never straddle two blocks, a tail too
+  // short for the next word is padded with spaces. Returns the word count.
+  //
+  // Every word of the vocabulary is written at least once : each block owns
+  // the slice of a seeded permutation of the vocabulary proportional to its
+  // byte range and mixes those words in at random places between the words
+  // drawn from the distribution, forcing them in once only they still fit.
+  auto fill(std::uint64_t block_index, std::string& buffer)
+    -> std::uint64_t
+  {
+    std::mt19937_64 generator { splitmix64(splitmix64(m_options.seed) + block_index) };
+    std::uniform_int_distribution<std::uint64_t> uniform { 0u, m_vocabulary.size() - 1u };
+    std::uniform_real_distribution<double> coin { 0.0, 1.0 };
+    auto& the_used_words = used_words_of_this_worker();
+
+    const auto offset = block_index * m_options.block_size;
+    auto next_owned = owned_word(offset);
+    const auto end_owned = owned_word(offset + buffer.size());
+    auto owned_bytes_left = owned_bytes(next_owned, end_owned);
+
+    constexpr auto max_sampled_bytes = synthetic_vocabulary::max_word_length + 2u;
+    char word [max_sampled_bytes];
+    std::uint64_t num_words { 0u };
+    std::size_t here { 0u };
+    for (;;)
+    {
+      const auto bytes_left = buffer.size() - here;
+      const auto is_owned = next_owned < end_owned
+        && (bytes_left < owned_bytes_left + max_sampled_bytes || coin(generator) * bytes_left < owned_bytes_left);
+      std::uint64_t index;
+      std::size_t length;
+      if (is_owned)
+      {
+        index = permuted(next_owned++);
+        length = m_vocabulary.word(index, word);
+        word[length++] = ' ';
+        owned_bytes_left -= length;
+      }
+      else
+      {
+        index = m_options.distribution == distribution_type::zipf ? m_zipf(generator) : uniform(generator);
+        length = m_vocabulary.word(index, word);
+        word[length++] = ' ';
+        if (generator() & 0x1u)
+          word[length++] = ' ';
+        if (here + length > buffer.size())
+          break;
+      }
+      std::copy_n(word, length, buffer.data() + here);
+      here += length;
+      the_used_words[index / 64u] |= 1ull << (index % 64u);
+      ++num_words;
+    }
+    std::fill(buffer.begin() + here, buffer.end(), ' ');
+    return num_words;
+  }
+
+  // Throws unless the words owned by every block fit in it, to be checked
+  // before any block is written.
+  void check_fit() const
+  {
+    for (std::uint64_t offset = 0u; offset < m_options.target_size; offset += m_options.block_size)
+    {
+      const auto end_offset = std::min(offset + m_options.block_size, m_options.target_size);
+      if (owned_bytes(owned_word(offset), owned_word(end_offset)) > end_offset - offset)
+        throw std::runtime_error(fmt::format("{} distinct words do not fit in {} bytes, raise --size or lower --unique",
+          m_options.vocabulary_size, m_options.target_size));
+    }
+  }
+
+  auto count_unique() const
+    -> std::uint64_t
+  {
+    std::uint64_t the_count { 0u };
+    for (auto i = 0u; i < bitset_size(); ++i)
+    {
+      std::uint64_t the_bits { 0u };
+      for (const auto& the_used_words : m_used_words)
+        the_bits |= the_used_words.empty() ? 0u : the_used_words[i];
+      the_count += std::popcount(the_bits);
+    }
+    return the_count;
+  }
+
+private:
+  auto bitset_size() const -> std::size_t
+  {
+    return (m_vocabulary.size() + 63u) / 64u;
+  }
+
+  // Products of a vocabulary size and a byte offset can overflow 64 bits.
+  using wide_type = unsigned __int128;
+
+  // First position in the vocabulary permutation owned by the block that
+  // starts at this byte offset.
+  auto owned_word(std::uint64_t offset) const
+    -> std::uint64_t
+  {
+    return static_cast<std::uint64_t> (wide_type { m_vocabulary.size() } * offset / m_options.target_size);
+  }
+
+  auto permuted(std::uint64_t position) const
+    -> std::uint64_t
+  {
+    return static_cast<std::uint64_t> ((wide_type { position } * m_stride + m_shift) % m_vocabulary.size());
+  }
+
+  // Bytes taken by the words at positions [first, last) of the permutation,
+  // each followed by a space.
+  auto owned_bytes(std::uint64_t first, std::uint64_t last) const
+    -> std::uint64_t
+  {
+    std::uint64_t the_bytes { 0u };
+    for (auto k = first; k < last; ++k)
+      the_bytes += m_vocabulary.length(permuted(k)) + 1u;
+    return the_bytes;
+  }
+
+  static auto coprime_stride(std::uint64_t size, std::uint64_t seed)
+    -> std::uint64_t
+  {
+    auto stride = splitmix64(seed) % size | 1u;
+    while (std::gcd(stride, size) != 1u)
+      stride += 2u;
+    return stride;
+  }
+
+  auto used_words_of_this_worker()
+    -> std::vector<std::uint64_t>&
+  {
+    auto& the_used_words = m_used_words.at(parallel_task_dispatch::current_index());
+    if (the_used_words.empty())
+      the_used_words.resize(bitset_size());
+    return the_used_words;
+  }
+
+  const generator_options&                m_options;
+  synthetic_vocabulary                    m_vocabulary;
+  zipf_distribution                       m_zipf;
+  std::vector<std::vector<std::uint64_t>> m_used_words;
+  std::uint64_t                           m_stride;
+  std::uint64_t                           m_shift;
+};
+
+void write_expected(const generator_options& options, std::uint64_t unique_words, std::uint64_t total_words)
+{
+  auto sidecar_path = options.output_path;
+  sidecar_path += ".expected";
+  std::ofstream sidecar { sidecar_path };
+  sidecar << "unique_words " << unique_words << "\n"
+          << "total_words " << total_words << "\n"
+          << "bytes " << options.target_size << "\n"
+          << "vocabulary " << options.vocabulary_size << "\n"
+          << "distribution " << (options.distribution == distribution_type::zipf
+                                  ? fmt::format("zipf {}", options.zipf_exponent) : std::string { "uniform" }) << "\n"
+          << "seed " << options.seed << "\n";
+  if (!sidecar)
+    throw std::runtime_error(fmt::format("Could not write '{}'", sidecar_path.string()));
+}
+
+int main(int argc, char** argv)
+{
+  using namespace std;
+
+  try
+  {
+    const auto options = args_parse_generator_options({ argv, argv + argc });
+    const auto num_threads = options.num_threads ? options.num_threads : max(1u, thread::hardware_concurrency());
+    const auto num_blocks = (options.target_size + options.block_size - 1u) / options.block_size;
+
+    block_generator the_generator { options, num_threads };
+    the_generator.check_fit();
+    auto the_file = file_wrapper::create(options.output_path, 0644);
+    the_file.resize(options.target_size);
+    // Declared last so that on an exception its workers are joined before the
+    // generator and the file the blocks in flight use go away.
+    parallel_task_dispatch the_thread_pool { num_threads };
+
+    cout << fmt::format("Building {} bytes from {} words, {} blocks on {} threads...\n",
+      options.target_size, options.vocabulary_size, num_blocks, num_threads);
+
+    // At most a few blocks per thread in flight, each one owns its buffer.
+    const auto max_in_flight = num_threads * 4u;
+    deque<future<uint64_t>> blocks_in_flight;
+    uint64_t total_words { 0u };
+    uint64_t blocks_done { 0u };
+    for (uint64_t block_index = 0u; block_index < num_blocks || !blocks_in_flight.empty(); )
+    {
+      if (block_index < num_blocks && blocks_in_flight.size() < max_in_flight)
+      {
+        blocks_in_flight.emplace_back(the_thread_pool.async([&, block_index] () -> uint64_t
+        {
+          const auto offset = block_index * options.block_size;
+          std::string buffer (min(options.block_size, options.target_size - offset), ' ');
+          const auto num_words = the_generator.fill(block_index, buffer);
+          the_file.write_at(buffer, offset);
+          return num_words;
+        }));
+        ++block_index;
+        continue;
+      }
+      total_words += blocks_in_flight.front().get();
+      blocks_in_flight.pop_front();
+      ++blocks_done;
+      cout << fmt::format("Progress so far : {} / {} blocks | {} %\r", blocks_done, num_blocks, blocks_done * 100u / num_blocks) << flush;
+    }
+
+    const auto unique_words = the_generator.count_unique();
+    write_expected(options, unique_words, total_words);
+    cout << fmt::format("\nWrote {} words, {} distinct\n", total_words, unique_words);
+    return 0;
+  }
+  catch (const exception& ex)
+  {
+    cout << ex.what() << '\n';
+  }
+  return -1;
+}
@@ -21,11 +21,11 @@ int main(int argc, char** argv)
     vector<filesystem::path> args{ argv, argv + argc };
 
     if (args.size() < 2)
-      throw runtime_error(format("No file given as argument"s));
+      throw runtime_error(format("No file given as argument"));
     if (!filesystem::exists(args.at(1)))
-      throw runtime_error(format("File '{}' not found"s, args.at(1).string()));
+      throw runtime_error(format("File '{}' not found", args.at(1).string()));
     if (!filesystem::file_size(args.at(1)))
-      throw runtime_error(format("File '{}' is empty!"s, args.at(1).string()));
+      throw runtime_error(format("File '{}' is empty!", args.at(1).string()));
 
     ifstream in_file(args.at(1), ios::binary);
 
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <optional>
+#include <coroutine>
+
+#include "parallel_task_dispatch.hpp"
+#include "pinned_object.hpp"
+
+// Bounded multi-producer / multi-consumer channel between coroutines. A push
+// into a full channel suspends the producer until a consumer makes room, a pop
+// from an empty one suspends until an item arrives or the channel is closed.
+// Suspended coroutines are resumed on the thread pool, never inline.
+template <typename Item_type>
+struct async_channel: pinned_object
+{
+  async_channel (parallel_task_dispatch& thread_pool, std::size_t capacity)
+  : m_thread_pool { thread_pool },
+    m_capacity { capacity }
+  {}
+
+  struct push_awaiter
+  {
+    bool await_ready () const noexcept { return false; }
+
+    bool await_suspend (std::coroutine_handle<> handle)
+    {
+      m_handle = handle;
+      return m_channel.try_push_or_park (*this);
+    }
+
+    bool await_resume () const noexcept { return m_pushed; }
+
+    async_channel&          m_channel;
+    Item_type               m_item;
+    std::coroutine_handle<> m_handle {};
+    bool                    m_pushed { false };
+  };
+
+  struct pop_awaiter
+  {
+    bool await_ready () const noexcept { return false; }
+
+    bool await_suspend (std::coroutine_handle<> handle)
+    {
+      m_handle = handle;
+      return m_channel.try_pop_or_park (*this);
+    }
+
+    auto await_resume () -> std::optional<Item_type> { return std::move (m_item); }
+
+    async_channel&           m_channel;
+    std::optional<Item_type> m_item {};
+    std::coroutine_handle<>  m_handle {};
+  };
+
+  // Resumes with false if the channel was closed before the item got in.
+  [[nodiscard]]
+  auto push (Item_type item) -> push_awaiter
+  {
+    return push_awaiter { *this, std::move (item) };
+  }
+
+  // Resumes with an empty optional once the channel is closed and drained.
+  [[nodiscard]]
+  auto pop () -> pop_awaiter
+  {
+    return pop_awaiter { *this };
+  }
+
+  void close ()
+  {
+    std::vector<std::coroutine_handle<>> to_resume;
+    {
+      std::unique_lock hold_lock { m_mutex };
+      m_closed = true;
+      for (auto* pusher : m_pushers)
+        to_resume.push_back (pusher->m_handle);
+      for (auto* popper : m_poppers)
+        to_resume.push_back (popper->m_handle);
+      m_pushers.clear ();
+      m_poppers.clear ();
+    }
+    for (auto handle : to_resume)
+      resume_on_pool (handle);
+  }
+
+private:
+  // Both return true when the awaiting coroutine has to stay suspended.
+  bool try_push_or_park (push_awaiter& pusher)
+  {
+    std::unique_lock hold_lock { m_mutex };
+    if (m_closed)
+      return false;
+    pusher.m_pushed = true;
+    if (!m_poppers.empty ())
+    {
+      auto* popper = m_poppers.front ();
+      m_poppers.pop_front ();
+      popper->m_item.emplace (std::move (pusher.m_item));
+      hold_lock.unlock ();
+      resume_on_pool (popper->m_handle);
+      return false;
+    }
+    if (m_items.size () < m_capacity)
+    {
+      m_items.emplace_back (std::move (pusher.m_item));
+      return false;
+    }
+    pusher.m_pushed = false;
+    m_pushers.push_back (&pusher);
+    return true;
+  }
+
+  bool try_pop_or_park (pop_awaiter& popper)
+  {
+    std::unique_lock hold_lock { m_mutex };
+    if (!m_items.empty ())
+    {
+      popper.m_item.emplace (std::move (m_items.front ()));
+      m_items.pop_front ();
+      if (!m_pushers.empty ())
+      {
+        auto* pusher = m_pushers.front ();
+        m_pushers.pop_front ();
+        m_items.emplace_back (std::move (pusher->m_item));
+        pusher->m_pushed = true;
+        hold_lock.unlock ();
+        resume_on_pool (pusher->m_handle);
+      }
+      return false;
+    }
+    if (!m_pushers.empty ())
+    {
+      auto* pusher = m_pushers.front ();
+      m_pushers.pop_front ();
+      popper.m_item.emplace (std::move (pusher->m_item));
+      pusher->m_pushed = true;
+      hold_lock.unlock ();
+      resume_on_pool (pusher->m_handle);
+      return false;
+    }
+    if (m_closed)
+      return false;
+    m_poppers.push_back (&popper);
+    return true;
+  }
+
+  void resume_on_pool (std::coroutine_handle<> handle)
+  {
+    m_thread_pool.enqueue ([handle] (std::size_t) { handle.resume (); });
+  }
+
+private:
+  parallel_task_dispatch&   m_thread_pool;
+  const std::size_t         m_capacity;
+  std::mutex                m_mutex;
+  std::deque<Item_type>     m_items;
+  std::deque<push_awaiter*> m_pushers;
+  std::deque<pop_awaiter*>  m_poppers;
+  bool                      m_closed { false };
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <utility>
+#include <optional>
+#include <exception>
+#include <coroutine>
+
+// Lazily evaluated sequence whose body is allowed to co_await, the consumer
+// pulls one value at a time with `co_await generator.next ()`.
+template <typename T>
+struct async_generator
+{
+  struct promise_type
+  {
+    auto get_return_object () noexcept -> async_generator
+    {
+      return async_generator { std::coroutine_handle<promise_type>::from_promise (*this) };
+    }
+
+    auto initial_suspend () noexcept -> std::suspend_always { return {}; }
+
+    auto final_suspend () noexcept
+    {
+      return yield_awaiter {};
+    }
+
+    auto yield_value (T value) -> auto
+    {
+      m_current.emplace (std::move (value));
+      return yield_awaiter {};
+    }
+
+    void return_void () noexcept {}
+
+    void unhandled_exception () noexcept
+    {
+      m_exception = std::current_exception ();
+    }
+
+    struct yield_awaiter
+    {
+      bool await_ready () const noexcept { return false; }
+
+      auto await_suspend (std::coroutine_handle<promise_type> handle) noexcept
+        -> std::coroutine_handle<>
+      {
+        return handle.promise ().m_consumer;
+      }
+
+      void await_resume () const noexcept {}
+    };
+
+    std::optional<T>        m_current;
+    std::exception_ptr      m_exception;
+    std::coroutine_handle<> m_consumer;
+  };
+
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  explicit async_generator (handle_type handle) noexcept
+  : m_handle { handle }
+  {}
+
+  async_generator (const async_generator&) = delete;
+  async_generator& operator = (const async_generator&) = delete;
+
+  async_generator (async_generator&& other) noexcept
+  : m_handle { std::exchange (other.m_handle, nullptr) }
+  {}
+
+  auto operator = (async_generator&& other) noexcept -> async_generator&
+  {
+    async_generator tmp { std::move (other) };
+    std::swap (m_handle, tmp.m_handle);
+    return *this;
+  }
+
+ ~async_generator ()
+  {
+    if (m_handle)
+      m_handle.destroy ();
+  }
+
+  // Resumes the generator until it yields, an empty optional marks the end.
+  auto next () noexcept
+  {
+    struct awaiter
+    {
+      bool await_ready () const noexcept
+      {
+        return m_handle.done ();
+      }
+
+      auto await_suspend (std::coroutine_handle<> consumer) noexcept
+        -> std::coroutine_handle<>
+      {
+        m_handle.promise ().m_consumer = consumer;
+        return m_handle;
+      }
+
+      auto await_resume () -> std::optional<T>
+      {
+        auto& promise = m_handle.promise ();
+        if (promise.m_exception)
+          std::rethrow_exception (std::exchange (promise.m_exception, nullptr));
+        return std::exchange (promise.m_current, std::nullopt);
+      }
+
+      handle_type m_handle;
+    };
+    return awaiter { m_handle };
+  }
+
+private:
+  handle_type m_handle;
+};
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <variant>
+#include <utility>
+#include <optional>
+#include <exception>
+#include <coroutine>
+#include <semaphore>
+#include <type_traits>
+
+template <typename T = void>
+struct async_task;
+
+namespace detail
+{
+  template <typename T>
+  struct async_task_result
+  {
+    template <typename Value_type>
+    requires (std::is_convertible_v<Value_type, T>)
+    void return_value (Value_type&& value)
+    {
+      m_result.template emplace<1> (std::forward<Value_type> (value));
+    }
+
+    void unhandled_exception () noexcept
+    {
+      m_result.template emplace<2> (std::current_exception ());
+    }
+
+    auto result () -> T
+    {
+      if (m_result.index () == 2)
+        std::rethrow_exception (std::get<2> (m_result));
+      return std::move (std::get<1> (m_result));
+    }
+
+  private:
+    std::variant<std::monostate, T, std::exception_ptr> m_result;
+  };
+
+  template <>
+  struct async_task_result<void>
+  {
+    void return_void () noexcept {}
+
+    void unhandled_exception () noexcept
+    {
+      m_exception = std::current_exception ();
+    }
+
+    void result ()
+    {
+      if (m_exception)
+        std::rethrow_exception (m_exception);
+    }
+
+  private:
+    std::exception_ptr m_exception;
+  };
+
+  // Fire-and-forget coroutine used to drive a lazy task from non-coroutine code,
+  // it starts eagerly and frees its own frame when done.
+  struct detached_task
+  {
+    struct promise_type
+    {
+      auto get_return_object () noexcept -> detached_task { return {}; }
+      auto initial_suspend () noexcept -> std::suspend_never { return {}; }
+      auto final_suspend () noexcept -> std::suspend_never { return {}; }
+      void return_void () noexcept {}
+      void unhandled_exception () noexcept { std::terminate (); }
+    };
+  };
+}
+
+// Lazily started coroutine, the body runs once the task is awaited and
+// control is transferred back to the awaiting coroutine when it finishes.
+template <typename T>
+struct async_task
+{
+  struct promise_type: detail::async_task_result<T>
+  {
+    auto get_return_object () noexcept -> async_task
+    {
+      return async_task { std::coroutine_handle<promise_type>::from_promise (*this) };
+    }
+
+    auto initial_suspend () noexcept -> std::suspend_always { return {}; }
+
+    auto final_suspend () noexcept
+    {
+      struct final_awaiter
+      {
+        bool await_ready () const noexcept { return false; }
+
+        auto await_suspend (std::coroutine_handle<promise_type> handle) noexcept
+          -> std::coroutine_handle<>
+        {
+          auto continuation = handle.promise ().m_continuation;
+          return continuation ? continuation : std::noop_coroutine ();
+        }
+
+        void await_resume () const noexcept {}
+      };
+      return final_awaiter {};
+    }
+
+    std::coroutine_handle<> m_continuation;
+  };
+
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  async_task () noexcept = default;
+
+  explicit async_task (handle_type handle) noexcept
+  : m_handle { handle }
+  {}
+
+  async_task (const async_task&) = delete;
+  async_task& operator = (const async_task&) = delete;
+
+  async_task (async_task&& other) noexcept
+  : m_handle { std::exchange (other.m_handle, nullptr) }
+  {}
+
+  auto operator = (async_task&& other) noexcept -> async_task&
+  {
+    async_task tmp { std::move (other) };
+    std::swap (m_handle, tmp.m_handle);
+    return *this;
+  }
+
+ ~async_task ()
+  {
+    if (m_handle)
+      m_handle.destroy ();
+  }
+
+  auto operator co_await () noexcept
+  {
+    struct awaiter
+    {
+      bool await_ready () const noexcept
+      {
+        return !m_handle || m_handle.done ();
+      }
+
+      auto await_suspend (std::coroutine_handle<> continuation) noexcept
+        -> std::coroutine_handle<>
+      {
+        m_handle.promise ().m_continuation = continuation;
+        return m_handle;
+      }
+
+      auto await_resume () -> T
+      {
+        return m_handle.promise ().result ();
+      }
+
+      handle_type m_handle;
+    };
+    return awaiter { m_handle };
+  }
+
+private:
+  handle_type m_handle { nullptr };
+};
+
+// Blocks the calling thread until the task has finished and returns its result.
+template <typename T>
+auto sync_wait (async_task<T> task) -> T
+{
+  std::binary_semaphore is_done { 0 };
+  std::exception_ptr failure;
+  std::conditional_t<std::is_void_v<T>, std::monostate, std::optional<T>> result;
+
+  [] (auto& task, auto& result, auto& failure, auto& is_done) -> detail::detached_task
+  {
+    try
+    {
+      if constexpr (std::is_void_v<T>)
+        co_await task;
+      else
+        result.emplace (co_await task);
+    }
+    catch (...)
+    {
+      failure = std::current_exception ();
+    }
+    is_done.release ();
+  } (task, result, failure, is_done);
+
+  is_done.acquire ();
+  if (failure)
+    std::rethrow_exception (failure);
+  if constexpr (!std::is_void_v<T>)
+    return std::move (result.value ());
+}
+
+// Starts all the tasks at once and resumes the awaiting coroutine after the last
+// one has finished, the first exception thrown by any of them is rethrown.
+inline auto when_all (std::vector<async_task<void>> tasks)
+  -> async_task<void>
+{
+  struct when_all_awaiter
+  {
+    bool await_ready () const noexcept
+    {
+      return m_tasks.empty ();
+    }
+
+    bool await_suspend (std::coroutine_handle<> continuation)
+    {
+      m_continuation = continuation;
+      m_count.store (m_tasks.size () + 1, std::memory_order::relaxed);
+      for (auto i = 0u; i < m_tasks.size (); ++i)
+        run_one (*this, i);
+      return !count_down ();
+    }
+
+    void await_resume ()
+    {
+      for (auto&& failure : m_failures)
+        if (failure)
+          std::rethrow_exception (failure);
+    }
+
+    bool count_down () noexcept
+    {
+      return m_count.fetch_sub (1, std::memory_order::acq_rel) == 1;
+    }
+
+    static auto run_one (when_all_awaiter& self, std::size_t index) -> detail::detached_task
+    {
+      try
+      {
+        co_await self.m_tasks[index];
+      }
+      catch (...)
+      {
+        self.m_failures[index] = std::current_exception ();
+      }
+      if (self.count_down ())
+        self.m_continuation.resume ();
+    }
+
+    std::vector<async_task<void>>&  m_tasks;
+    std::vector<std::exception_ptr> m_failures;
+    std::coroutine_handle<>         m_continuation {};
+    std::atomic<std::size_t>        m_count { 0u };
+  };
+
+  when_all_awaiter the_awaiter { tasks, std::vector<std::exception_ptr> (tasks.size ()) };
+  co_await the_awaiter;
+}
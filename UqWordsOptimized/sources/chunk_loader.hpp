@@ -1,11 +1,16 @@
 #pragma once
 
+#include <bit>
 #include <cstdint>
+#include <algorithm>
+#include <vector>
 #include <optional>
 #include <string_view>
 #include <filesystem>
 
 #include "file_wrapper.hpp"
+#include "word_hash.hpp"
+#include "async_generator.hpp"
 
 struct chunk_loader
 {
@@ -23,6 +28,14 @@ struct chunk_loader
 
     template <typename _Transform = std::string_view, typename _It_type>
     auto split_into(_It_type out_it, char delimiter = ' ') const
+    {
+      for_each_word ([&out_it] (std::string_view word) {
+        *(out_it++) = _Transform (word);
+      }, delimiter);
+    }
+
+    template <typename _Callback>
+    void for_each_word(_Callback&& callback, char delimiter = ' ') const
     {
       auto view = as_string_view();
       auto start_here = view.find_first_not_of(delimiter);    
@@ -31,7 +44,51 @@ struct chunk_loader
         auto end_here = view.find_first_of(delimiter, start_here);
         auto word = view.substr(start_here, end_here - start_here);
         start_here = view.find_first_not_of(delimiter, end_here);        
-        *(out_it++) = _Transform (word);
+        callback (word);
+      }
+    }
+
+    // Fused tokenizer, computes word_hash of each word while scanning for the
+    // delimiter eight bytes at a time, callback receives (word, hash).
+    template <typename _Callback>
+    void for_each_hashed_word(_Callback&& callback, char delimiter = ' ') const
+    {
+      constexpr auto ones = 0x0101010101010101ull;
+      constexpr auto highs = 0x8080808080808080ull;
+      const auto delimiters = ones * static_cast<std::uint8_t> (delimiter);
+
+      auto view = as_string_view();
+      auto here = view.data();
+      const auto end = here + view.size();
+      while (here != end)
+      {
+        if (*here == delimiter) {
+          ++here;
+          continue;
+        }
+        const auto word_begin = here;
+        auto state = word_hash::seed;
+        for (;;)
+        {
+          const auto take = std::min<std::size_t> (end - here, 8u);
+          const auto block = word_hash::load_block (here, take);
+          const auto x = block ^ delimiters;
+          auto found = (x - ones) & ~x & highs;
+          if (take < 8u)
+            found |= 0x80ull << (take * 8u);
+          if (!found) {
+            state = word_hash::step (state, block);
+            here += 8u;
+            continue;
+          }
+          const auto length = std::countr_zero (found) / 8u;
+          if (length > 0u)
+            state = word_hash::step (state, block & (~0ull >> (64u - length * 8u)));
+          here += length;
+          break;
+        }
+        const auto word_length = static_cast<std::size_t> (here - word_begin);
+        callback (std::string_view { word_begin, word_length }, word_hash::finish (state, word_length));
       }
     }
 
@@ -44,25 +101,41 @@ struct chunk_loader
 
   chunk_loader(std::filesystem::path path, std::size_t chunk_size)
   : m_file { file_wrapper::open(path, O_RDONLY) },
-    m_chunk_size { chunk_size },
-    m_bytes_left { m_file.size() }  
+    m_chunk_size { std::max<std::size_t> (chunk_size, 1u) },
+    m_file_size { m_file.size() },
+    m_bytes_left { m_file_size }  
   {}
 
+  // Chunks end right after the last delimiter in the window. A window without
+  // any delimiter (a token longer than the chunk size) is grown until the token
+  // ends, and the last chunk of the file keeps a final unterminated word.
   auto next (char delimiter = ' ') -> std::optional<chunk_type> 
   {
     if (m_bytes_left <= 0) {
       return std::nullopt;
     }
 
-    auto bytes_to_take = std::min (m_bytes_left, m_chunk_size);
-    auto start_here = m_file.size() - m_bytes_left;
-    auto [handle, s_view] = m_file.map_string_view(start_here, start_here + bytes_to_take);
-    auto last_space_off = s_view.find_last_of(delimiter) + 1;
-    
-    s_view = s_view.substr(0, last_space_off);
-    m_bytes_left -= last_space_off;    
+    auto bytes_to_take = std::min<std::uint64_t> (m_bytes_left, m_chunk_size);
+    auto start_here = m_file_size - m_bytes_left;
+    for (;;)
+    {
+      auto [handle, s_view] = m_file.map_string_view(start_here, start_here + bytes_to_take, PROT_READ, MAP_SHARED, m_file_size);
+      if (bytes_to_take == m_bytes_left) 
+      {
+        m_bytes_left = 0;
+        return chunk_type { std::move (handle), std::move (s_view) };
+      }
 
-    return chunk_type { std::move (handle), std::move (s_view) };
+      auto last_space_off = s_view.find_last_of(delimiter);
+      if (last_space_off != std::string_view::npos)
+      {
+        s_view = s_view.substr(0, last_space_off + 1);
+        m_bytes_left -= last_space_off + 1;    
+        return chunk_type { std::move (handle), std::move (s_view) };
+      }
+      
+      bytes_to_take = std::min<std::uint64_t> (m_bytes_left, bytes_to_take * 2u);
+    }
   }
 
   auto next_shared (char delimiter = ' ') -> std::shared_ptr<chunk_type>
@@ -73,6 +146,66 @@ struct chunk_loader
     return {};
   }
 
+  auto async_chunks (char delimiter = ' ') -> async_generator<shared_chunk_type>
+  {
+    while (auto the_chunk = (*this).next_shared(delimiter))
+      co_yield std::move (the_chunk);
+  }
+
+  // Loads the words that start in [offset, offset + chunk size), whole, no
+  // matter where the range cuts them. Ranges that tile the file give every
+  // word exactly once, like next (), but in any order. Does not touch the
+  // sequential position used by next ().
+  auto load_at (std::uint64_t offset, char delimiter = ' ') -> std::optional<chunk_type>
+  {
+    if (offset >= m_file_size) {
+      return std::nullopt;
+    }
+
+    // The byte before the range tells whether a word starts right at offset.
+    const auto begin = offset > 0u ? offset - 1u : offset;
+    const auto limit = static_cast<std::size_t> (std::min (m_file_size, offset + m_chunk_size) - begin);
+    auto end = std::min (m_file_size, offset + m_chunk_size);
+    for (auto grow_by = std::uint64_t { m_chunk_size };; grow_by *= 2u)
+    {
+      auto [handle, s_view] = m_file.map_string_view(begin, end, PROT_READ, MAP_SHARED, m_file_size);
+      std::size_t first_word { 0u };
+      if (offset > 0u)
+      {
+        // Everything up to the first delimiter belongs to a word that started
+        // before the range, none may start in it at all.
+        const auto leading_space_off = s_view.find(delimiter);
+        if (leading_space_off == std::string_view::npos || leading_space_off + 1u >= limit)
+          return chunk_type { mmap_wrapper {}, std::string_view {} };
+        first_word = leading_space_off + 1u;
+      }
+
+      // A delimiter at limit - 1 means the next range owns the word after it.
+      auto last_space_off = s_view.find(delimiter, limit - 1u);
+      if (last_space_off == std::string_view::npos && end != m_file_size)
+      {
+        end = std::min (m_file_size, end + grow_by);
+        continue;
+      }
+      last_space_off = std::min (last_space_off, s_view.size());
+      s_view = s_view.substr(first_word, last_space_off - first_word);
+      return chunk_type { std::move (handle), std::move (s_view) };
+    }
+  }
+
+  auto async_chunks_at (std::vector<std::uint64_t> offsets, char delimiter = ' ') -> async_generator<shared_chunk_type>
+  {
+    for (const auto offset : offsets)
+    {
+      if (auto maybe_chunk = (*this).load_at(offset, delimiter); maybe_chunk.has_value ())
+        co_yield std::make_shared<chunk_type>(std::move (maybe_chunk.value ()));
+    }
+  }
+
+  auto chunk_size () const -> std::size_t { return m_chunk_size; }
+
+  auto file_size () const -> std::uint64_t { return m_file_size; }
+
   auto bytes_left () const -> std::size_t { return m_bytes_left; }
 
   auto empty () const -> bool { return m_bytes_left == 0; }
@@ -80,5 +213,6 @@ struct chunk_loader
 private:
   file_wrapper  m_file;  
   std::size_t   m_chunk_size;
+  std::uint64_t m_file_size;
   std::uint64_t m_bytes_left;
 };
\ No newline at end of file
@@ -78,13 +78,19 @@ struct concurrent_queue: pinned_object
       m_empty.wait (hold_lock); 
   }
 
- ~concurrent_queue ()
+  // Wakes up everyone blocked in wait_pop, which from now on returns false.
+  void done ()
   {
     std::unique_lock<std::mutex> hold_lock { m_mutex };
     m_done = true;
     m_ready.notify_all ();
   }
 
+ ~concurrent_queue ()
+  {
+    done ();
+  }
+
 private:  
   std::deque<Item_type>   m_items;
   mutable std::mutex      m_mutex;
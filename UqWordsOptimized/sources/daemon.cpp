@@ -0,0 +1,363 @@
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <charconv>
+#include <iostream>
+#include <stdexcept>
+#include <filesystem>
+#include <string_view>
+
+#include <signal.h>
+#include <pthread.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+
+#include <fmt/format.h>
+
+#include "uqwords.hpp"
+#include "file_wrapper.hpp"
+#include "program_args.hpp"
+
+// Line based protocol, one request per line, answered with "OK ..." or "ERR ..." :
+//
+//   PING                    -> OK
+//   COUNT <path>            -> OK <distinct words>
+//   TOPK <k> <path>         -> OK <n> followed by n lines "<count> <word>", reads
+//                              the whole file even when it is indexed
+//   INDEX <path>            -> OK <distinct words>, keeps the vocabulary in memory
+//   LOOKUP <word> <path>    -> OK 1 or OK 0
+//   DROP <path>             -> OK 1 or OK 0
+//
+// Paths are the rest of the line, so they may contain spaces.
+
+struct daemon_options
+{
+  std::filesystem::path  socket_path;
+  uqwords::engine_options engine;
+};
+
+auto args_parse_daemon_options(std::vector<std::string_view> args)
+  -> daemon_options
+{
+  using namespace std;
+  daemon_options options;
+  vector<std::string_view> positional;
+
+  for (std::size_t i = 1u; i < args.size(); ++i)
+  {
+    const auto arg = args[i];
+    if (!arg.starts_with("--"))
+      positional.push_back(arg);
+    else if (arg == "--no-prefilter")
+      options.engine.use_prefilter = false;
+    else if (const auto value = args_option_value(args, i, "--threads"))
+      options.engine.num_threads = args_parse_size(*value);
+    else if (const auto value = args_option_value(args, i, "--chunk-size"))
+      options.engine.chunk_size = args_parse_size(*value);
+    else if (const auto value = args_option_value(args, i, "--max-memory"))
+      options.engine.max_memory = args_parse_size(*value);
+    else
+      throw runtime_error(fmt::format("Unknown option '{}'", arg));
+  }
+  if (positional.size() != 1u)
+    throw runtime_error(fmt::format("Usage : {} <socket path> [--threads N] [--chunk-size SIZE] [--max-memory SIZE] [--no-prefilter]", args.front()));
+  options.socket_path = positional.front();
+  return options;
+}
+
+static std::atomic<bool> g_stop_requested { false };
+
+// Pause before accepting again when out of descriptors or threads.
+constexpr auto accept_backoff = std::chrono::milliseconds { 100 };
+
+auto listen_on(const std::filesystem::path& socket_path)
+  -> file_wrapper
+{
+  struct ::sockaddr_un address {};
+  const auto path_string = socket_path.string();
+  if (path_string.size() >= sizeof(address.sun_path))
+    throw std::runtime_error(fmt::format("Socket path '{}' is too long", path_string));
+  address.sun_family = AF_UNIX;
+  path_string.copy(address.sun_path, path_string.size());
+
+  file_wrapper listener { ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) };
+  if (listener.get() < 0)
+    throw std::system_error { errno, std::system_category() };
+  std::filesystem::remove(socket_path);
+  if (::bind(listener.get(), reinterpret_cast<const struct ::sockaddr*>(&address), sizeof(address)) < 0)
+    throw std::system_error { errno, std::system_category() };
+  if (::listen(listener.get(), SOMAXCONN) < 0)
+    throw std::system_error { errno, std::system_category() };
+  return listener;
+}
+
+// Only a broken listener is worth stopping the daemon for, anything else
+// concerns one connection or passes once some descriptors are closed.
+auto is_fatal_accept_error(int error)
+  -> bool
+{
+  return error == EBADF || error == EFAULT || error == EINVAL || error == ENOTSOCK || error == EOPNOTSUPP;
+}
+
+auto is_out_of_resources(int error)
+  -> bool
+{
+  return error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM || error == EAGAIN;
+}
+
+void write_all(const file_wrapper& connection, std::string_view data)
+{
+  while (!data.empty())
+  {
+    const auto written = ::send(connection.get(), data.data(), data.size(), MSG_NOSIGNAL);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written < 0)
+      throw std::system_error { errno, std::system_category() };
+    data.remove_prefix(written);
+  }
+}
+
+struct line_reader
+{
+  line_reader(const file_wrapper& connection)
+  : m_connection { connection }
+  {}
+
+  auto next(std::string& line) -> bool
+  {
+    for (;;)
+    {
+      if (auto end_of_line = m_buffer.find('\n'); end_of_line != std::string::npos)
+      {
+        line.assign(m_buffer, 0u, end_of_line);
+        if (!line.empty() && line.back() == '\r')
+          line.pop_back();
+        m_buffer.erase(0u, end_of_line + 1u);
+        return true;
+      }
+      char bytes [4096];
+      const auto received = ::recv(m_connection.get(), bytes, sizeof(bytes), 0);
+      if (received < 0 && errno == EINTR && !g_stop_requested)
+        continue;
+      if (received <= 0)
+        return false;
+      m_buffer.append(bytes, received);
+    }
+  }
+
+private:
+  const file_wrapper& m_connection;
+  std::string         m_buffer;
+};
+
+auto split_command(std::string_view line)
+  -> std::pair<std::string_view, std::string_view>
+{
+  const auto space = line.find(' ');
+  if (space == std::string_view::npos)
+    return { line, {} };
+  return { line.substr(0u, space), line.substr(space + 1u) };
+}
+
+auto handle_request(uqwords::engine& engine, std::string_view line)
+  -> std::string
+{
+  const auto [command, arguments] = split_command(line);
+  if (command == "PING")
+    return "OK\n";
+  if (arguments.empty())
+    throw std::runtime_error(fmt::format("Missing arguments for '{}'", command));
+  if (command == "COUNT")
+    return fmt::format("OK {}\n", engine.count_unique(arguments));
+  if (command == "INDEX")
+    return fmt::format("OK {}\n", engine.index(arguments));
+  if (command == "DROP")
+    return fmt::format("OK {}\n", engine.drop_index(arguments) ? 1 : 0);
+  if (command == "LOOKUP")
+  {
+    const auto [word, file_path] = split_command(arguments);
+    return fmt::format("OK {}\n", engine.lookup(file_path, word) ? 1 : 0);
+  }
+  if (command == "TOPK")
+  {
+    const auto [k_string, file_path] = split_command(arguments);
+    std::size_t k { 0u };
+    if (std::from_chars(k_string.data(), k_string.data() + k_string.size(), k).ec != std::errc{})
+      throw std::runtime_error(fmt::format("Invalid count '{}'", k_string));
+    const auto the_top = engine.top_k(file_path, k);
+    auto response = fmt::format("OK {}\n", the_top.size());
+    for (const auto& [word, count] : the_top)
+      response += fmt::format("{} {}\n", count, word);
+    return response;
+  }
+  throw std::runtime_error(fmt::format("Unknown command '{}'", command));
+}
+
+void serve_connection(uqwords::engine& engine, const file_wrapper& connection)
+{
+  line_reader reader { connection };
+  std::string line;
+  while (!g_stop_requested && reader.next(line))
+  {
+    if (line.empty())
+      continue;
+    std::string response;
+    try
+    {
+      response = handle_request(engine, line);
+    }
+    catch (const std::exception& ex)
+    {
+      response = fmt::format("ERR {}\n", ex.what());
+    }
+    write_all(connection, response);
+  }
+}
+
+// Serves every connection on a thread of its own, so an idle client never
+// holds up the others, the engine serializes the requests themselves.
+struct connection_threads
+{
+ ~connection_threads()
+  {
+    stop_all();
+  }
+
+  void serve(uqwords::engine& engine, file_wrapper connection)
+  {
+    std::unique_lock hold_lock { m_mutex };
+    reap_locked();
+    auto& the_connection = m_connections.emplace_back(std::move(connection));
+
+    // Stop signals have to reach the accept loop, not a connection thread.
+    ::sigset_t stop_signals, previous_signals;
+    ::sigemptyset(&stop_signals);
+    ::sigaddset(&stop_signals, SIGINT);
+    ::sigaddset(&stop_signals, SIGTERM);
+    ::pthread_sigmask(SIG_BLOCK, &stop_signals, &previous_signals);
+    try
+    {
+      the_connection.worker = std::jthread { [&engine, &the_connection] {
+        try
+        {
+          serve_connection(engine, the_connection.connection);
+        }
+        catch (const std::exception& ex)
+        {
+          std::cerr << ex.what() << '\n';
+        }
+        the_connection.is_done = true;
+      } };
+    }
+    catch (...)
+    {
+      // No thread for it, closing the connection tells the client.
+      ::pthread_sigmask(SIG_SETMASK, &previous_signals, nullptr);
+      m_connections.pop_back();
+      throw;
+    }
+    ::pthread_sigmask(SIG_SETMASK, &previous_signals, nullptr);
+  }
+
+  // Joins the threads done with their connection and closes those.
+  void reap()
+  {
+    std::unique_lock hold_lock { m_mutex };
+    reap_locked();
+  }
+
+  // Wakes the threads still waiting for a request and waits for all of them.
+  void stop_all()
+  {
+    std::unique_lock hold_lock { m_mutex };
+    for (auto& the_connection : m_connections)
+      ::shutdown(the_connection.connection.get(), SHUT_RDWR);
+    m_connections.clear();
+  }
+
+private:
+  void reap_locked()
+  {
+    m_connections.remove_if([] (const auto& the_connection) { return the_connection.is_done.load(); });
+  }
+
+  struct connection_type
+  {
+    connection_type(file_wrapper the_connection)
+    : connection { std::move(the_connection) }
+    {}
+
+    file_wrapper      connection;
+    std::atomic<bool> is_done { false };
+    std::jthread      worker;
+  };
+
+  std::mutex                 m_mutex;
+  std::list<connection_type> m_connections;
+};
+
+int main(int argc, char** argv)
+{
+  using namespace std;
+
+  try
+  {
+    const auto options = args_parse_daemon_options({ argv, argv + argc });
+
+    struct ::sigaction on_stop {};
+    on_stop.sa_handler = [] (int) { g_stop_requested = true; };
+    ::sigemptyset(&on_stop.sa_mask);
+    ::sigaction(SIGINT, &on_stop, nullptr);
+    ::sigaction(SIGTERM, &on_stop, nullptr);
+
+    uqwords::engine engine { options.engine };
+    connection_threads the_connections;
+    auto listener = listen_on(options.socket_path);
+    cerr << "Listening on " << options.socket_path.string() << "\n";
+
+    while (!g_stop_requested)
+    {
+      file_wrapper connection { ::accept4(listener.get(), nullptr, nullptr, SOCK_CLOEXEC) };
+      if (connection.get() < 0)
+      {
+        const auto the_error = errno;
+        if (the_error == EINTR)
+          continue;
+        if (is_fatal_accept_error(the_error))
+          throw std::system_error { the_error, std::system_category() };
+        cerr << fmt::format("accept : {}\n", std::system_category().message(the_error));
+        if (is_out_of_resources(the_error))
+        {
+          the_connections.reap();
+          this_thread::sleep_for(accept_backoff);
+        }
+        continue;
+      }
+      try
+      {
+        the_connections.serve(engine, std::move(connection));
+      }
+      catch (const std::system_error& ex)
+      {
+        // Out of threads, give the running ones time to finish.
+        cerr << fmt::format("connection : {}\n", ex.what());
+        the_connections.reap();
+        this_thread::sleep_for(accept_backoff);
+      }
+    }
+
+    filesystem::remove(options.socket_path);
+    return 0;
+  }
+  catch (const exception& ex)
+  {
+    cerr << ex.what() << '\n';
+  }
+  return -1;
+}
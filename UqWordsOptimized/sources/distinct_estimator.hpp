@@ -0,0 +1,344 @@
+#pragma once
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+#include <filesystem>
+
+#include "parallel_split_and_reduce.hpp"
+#include "word_count_map.hpp"
+
+// Estimates the number of distinct words of a file from a random sample of its
+// chunks. The sample frequency profile (f1 words seen once, f2 seen twice) goes
+// into Chao1 corrected for sampling without replacement, and into GEE, which
+// scales the singletons by sqrt (1 / q) for a sampled fraction q. Chunks are
+// dealt round robin into groups, leaving one group out at a time gives a
+// jackknife interval that follows from the sampled chunks themselves rather
+// than from a model of independently drawn words.
+struct distinct_estimate
+{
+  double estimate { 0.0 };
+  double lower { 0.0 };     // about estimate -/+ 1.96 jackknife standard errors
+  double upper { 0.0 };
+  double gee { 0.0 };
+  double coverage { 0.0 };  // Good-Turing sample coverage, 1 - f1 / n
+
+  // Half width of the interval relative to the estimate.
+  auto relative_error () const noexcept -> double
+  {
+    return estimate > 0.0 ? (upper - lower) / (2.0 * estimate) : 0.0;
+  }
+};
+
+struct frequency_profile
+{
+  std::uint64_t num_words { 0u };
+  std::uint64_t num_distinct { 0u };
+  std::uint64_t f1 { 0u };
+  std::uint64_t f2 { 0u };
+
+  static auto of (const word_count_map& the_counts) -> frequency_profile
+  {
+    frequency_profile the_profile;
+    the_counts.for_each ([&the_profile] (std::string_view, std::uint64_t count) {
+      the_profile.add (count);
+    });
+    return the_profile;
+  }
+
+  // Accounts for a word seen count times, or takes it back out.
+  void add (std::uint64_t count) noexcept
+  {
+    if (count == 0u)
+      return;
+    num_words += count;
+    ++num_distinct;
+    f1 += count == 1u;
+    f2 += count == 2u;
+  }
+
+  void remove (std::uint64_t count) noexcept
+  {
+    if (count == 0u)
+      return;
+    num_words -= count;
+    --num_distinct;
+    f1 -= count == 1u;
+    f2 -= count == 2u;
+  }
+
+  auto coverage () const noexcept -> double
+  {
+    return num_words ? 1.0 - double (f1) / double (num_words) : 0.0;
+  }
+};
+
+// Chao & Lin (2012) form of Chao1, the q / (1 - q) term takes the estimate to
+// the observed count as the sampled fraction q goes to 1. It is a lower bound,
+// far too low while most sampled words are singletons (low coverage).
+inline auto chao1_estimate(const frequency_profile& the_profile, double sampled_fraction)
+  -> double
+{
+  const auto observed = double (the_profile.num_distinct);
+  const auto f1 = double (the_profile.f1);
+  const auto f2 = double (the_profile.f2);
+  const auto n = std::max (double (the_profile.num_words), 2.0);
+  const auto q = std::clamp (sampled_fraction, 0.0, 1.0);
+  if (q >= 1.0 || f1 == 0.0)
+    return observed;
+
+  const auto a = (n - 1.0) / n;
+  const auto f0 = f2 > 0.0
+    ? f1 * f1 / (2.0 * f2 / a + f1 * q / (1.0 - q))
+    : f1 * (f1 - 1.0) / (2.0 / a + f1 * q / (1.0 - q));
+  return observed + f0;
+}
+
+inline auto gee_estimate(const frequency_profile& the_profile, double sampled_fraction)
+  -> double
+{
+  const auto f1 = double (the_profile.f1);
+  return std::sqrt (1.0 / std::clamp (sampled_fraction, 1e-12, 1.0)) * f1 + (double (the_profile.num_distinct) - f1);
+}
+
+// Chao1 and GEE of a sample, the interval is left open above : it takes the
+// jackknife below to put a bound on the words never seen.
+inline auto point_estimate(const frequency_profile& the_profile, double sampled_fraction)
+  -> distinct_estimate
+{
+  distinct_estimate the_result;
+  the_result.estimate = chao1_estimate (the_profile, sampled_fraction);
+  the_result.lower = double (the_profile.num_distinct);
+  the_result.upper = std::numeric_limits<double>::infinity ();
+  the_result.gee = gee_estimate (the_profile, sampled_fraction);
+  the_result.coverage = the_profile.coverage ();
+  return the_result;
+}
+
+// Delete-a-group jackknife of Chao1. the_counts holds the sum of the groups,
+// the profile without group g only changes for the words group g saw.
+inline auto jackknife_estimate(const word_count_map& the_counts, const frequency_profile& the_profile,
+    const std::vector<word_count_map>& the_groups, const std::vector<std::uint64_t>& group_chunks, std::uint64_t num_chunks)
+  -> distinct_estimate
+{
+  using namespace std;
+  std::uint64_t num_sampled { 0u };
+  for (const auto the_chunks : group_chunks)
+    num_sampled += the_chunks;
+  auto the_result = point_estimate (the_profile, double (num_sampled) / double (num_chunks));
+
+  vector<double> the_replicates;
+  for (auto g = 0u; g < the_groups.size (); ++g)
+  {
+    if (group_chunks[g] == 0u)
+      continue;
+    auto the_rest = the_profile;
+    the_groups[g].for_each ([&] (std::string_view word, std::uint64_t in_group) {
+      const auto in_total = the_counts.count (word, word_hash::of (word));
+      the_rest.remove (in_total);
+      the_rest.add (in_total - in_group);
+    });
+    the_replicates.push_back (chao1_estimate (the_rest, double (num_sampled - group_chunks[g]) / double (num_chunks)));
+  }
+
+  const auto k = double (the_replicates.size ());
+  if (k < 2.0)
+    return the_result;
+  auto the_mean = 0.0;
+  for (const auto the_replicate : the_replicates)
+    the_mean += the_replicate / k;
+  auto the_variance = 0.0;
+  for (const auto the_replicate : the_replicates)
+    the_variance += (the_replicate - the_mean) * (the_replicate - the_mean);
+  the_variance *= (k - 1.0) / k;
+
+  // The replicates share the downward bias of Chao1, the upper end also
+  // leaves room for as many unseen words again as it added.
+  const auto the_margin = 1.96 * sqrt (the_variance);
+  const auto the_observed = double (the_profile.num_distinct);
+  the_result.lower = max (the_result.estimate - the_margin, the_observed);
+  the_result.upper = max (the_result.estimate + the_margin, 2.0 * the_result.estimate - the_observed);
+  return the_result;
+}
+
+// Samples chunks in rounds, each round picks one not yet sampled chunk from
+// each of twice as many equal strata as the round before, so the sample stays
+// spread over the whole file. Chunks are also dealt round robin into
+// num_groups groups, counted apart by pipelines of their own (sharing the
+// pool) for the jackknife.
+//
+// Stops once the sample coverage is high enough for Chao1 to be trusted, the
+// words it adds to the ones seen, the jackknife interval and the change since
+// the previous round are all within the error bound. Gives up early when the
+// coverage can not get there.
+struct sampled_distinct_counter
+{
+  static constexpr std::size_t num_groups = 16u;
+  static constexpr std::size_t min_initial_strata = num_groups;
+  // Chunks are made smaller (down to a page) on files shorter than this many
+  // chunks, so the first rounds stay a small part of the file.
+  static constexpr auto min_num_chunks = 1024u;
+
+  struct result_type
+  {
+    distinct_estimate estimate;
+    double            sampled_fraction { 0.0 };
+    std::size_t       num_rounds { 0u };
+    bool              converged { false };
+
+    // When not converged : what is left to count exactly, with the words
+    // already seen in the sample.
+    std::size_t                chunk_size { 0u };
+    std::vector<std::uint64_t> unsampled_offsets;
+    word_count_map             sample;
+  };
+
+  sampled_distinct_counter (parallel_task_dispatch& thread_pool, std::uint32_t task_load_factor, std::uint64_t seed = 1u)
+  : m_random { seed }
+  {
+    for (auto g = 0u; g < num_groups; ++g)
+      m_counters.push_back (std::make_unique<parallel_split_and_reduce<word_count_map>> (thread_pool, task_load_factor));
+  }
+
+  void set_memory_budget(std::size_t max_bytes)
+  {
+    for (auto& the_counter : m_counters)
+      the_counter->set_memory_budget (max_bytes);
+  }
+
+  // Gives up (converged is false) rather than sample more than max_fraction
+  // of the file. Sampling all of the file is exact and always converged.
+  auto estimate(const std::filesystem::path& file_path, std::size_t block_size, double error_bound, double max_fraction = 0.125)
+    -> result_type
+  {
+    using namespace std;
+    const auto the_file_size = filesystem::file_size (file_path);
+    const auto the_chunk_size = parallel_split_and_reduce<word_count_map>::aligned_chunk_size (
+      min<uint64_t> (block_size, the_file_size / min_num_chunks));
+    const auto num_chunks = max<uint64_t> ((the_file_size + the_chunk_size - 1u) / the_chunk_size, 1u);
+    // Words never seen are mostly rarer than the singletons, keep their
+    // share of the text well under the error bound.
+    const auto min_coverage = 1.0 - error_bound / 2.0;
+
+    vector<bool> is_sampled (num_chunks, false);
+    vector<vector<uint64_t>> group_offsets (num_groups);
+    vector<uint64_t> group_chunks (num_groups, 0u);
+    word_count_map the_counts;
+    result_type the_result;
+    the_result.chunk_size = the_chunk_size;
+    uint64_t num_sampled { 0u };
+    // Enough strata to keep the pool busy, few enough for a couple of rounds
+    // before max_fraction.
+    const auto max_initial_strata = max<uint64_t> (min_initial_strata, uint64_t (max_fraction * double (num_chunks)) / 4u);
+    auto num_strata = min<uint64_t> ({ num_chunks, max_initial_strata,
+      max<uint64_t> (min_initial_strata, 4u * m_counters.front ()->thread_pool ().size ()) });
+    for (;;)
+    {
+      vector<uint64_t> offsets;
+      for (uint64_t stratum = 0u; stratum < num_strata; ++stratum)
+      {
+        const auto first = stratum * num_chunks / num_strata;
+        const auto last = (stratum + 1u) * num_chunks / num_strata;
+        if (auto the_chunk = pick_unsampled (is_sampled, first, last); the_chunk < last)
+        {
+          is_sampled[the_chunk] = true;
+          const auto g = num_sampled++ % num_groups;
+          offsets.push_back (the_chunk * the_chunk_size);
+          group_offsets[g].push_back (the_chunk * the_chunk_size);
+          ++group_chunks[g];
+        }
+      }
+
+      the_counts.merge (sync_wait (m_counters.front ()->apply_to_file_ranges_async (file_path, the_chunk_size, move (offsets))));
+
+      const auto the_previous = the_result.estimate.estimate;
+      the_result.sampled_fraction = double (num_sampled) / double (num_chunks);
+      const auto the_profile = frequency_profile::of (the_counts);
+      the_result.estimate = point_estimate (the_profile, the_result.sampled_fraction);
+      ++the_result.num_rounds;
+
+      if (num_sampled == num_chunks)
+      {
+        const auto exact = double (the_counts.size ());
+        the_result.estimate = { exact, exact, exact, exact, 1.0 };
+        the_result.converged = true;
+        return the_result;
+      }
+      const auto is_stable = the_result.num_rounds > 1u
+        && abs (the_result.estimate.estimate - the_previous) <= error_bound * the_result.estimate.estimate;
+      // Chao1 rather errs low, keep the words it adds to the ones seen within
+      // the error bound too. Counting the groups apart for the jackknife costs
+      // about as much as the sample did, only worth it once the cheaper tests
+      // pass.
+      const auto the_unseen = the_result.estimate.estimate - double (the_profile.num_distinct);
+      if (is_stable && the_result.estimate.coverage >= min_coverage && the_unseen <= error_bound * the_result.estimate.estimate)
+      {
+        const auto the_groups = count_groups (file_path, the_chunk_size, group_offsets);
+        the_result.estimate = jackknife_estimate (the_counts, the_profile, the_groups, group_chunks, num_chunks);
+        if (the_result.estimate.relative_error () <= error_bound)
+        {
+          the_result.converged = true;
+          return the_result;
+        }
+      }
+      // Under a Poisson model the missing mass 1 - coverage of a sample t times
+      // larger is at least its current value to the power t (Jensen), give up
+      // as soon as even that misses the coverage needed within max_fraction.
+      const auto the_growth = max_fraction / the_result.sampled_fraction;
+      if (pow (1.0 - the_result.estimate.coverage, the_growth) > 1.0 - min_coverage)
+        break;
+      num_strata = min<uint64_t> (num_chunks, num_strata * 2u);
+      if (double (num_sampled + num_strata) > max_fraction * double (num_chunks))
+        break;
+    }
+
+    for (uint64_t the_chunk = 0u; the_chunk < num_chunks; ++the_chunk)
+      if (!is_sampled[the_chunk])
+        the_result.unsampled_offsets.push_back (the_chunk * the_chunk_size);
+    the_result.sample = move (the_counts);
+    return the_result;
+  }
+
+private:
+  auto count_groups (const std::filesystem::path& file_path, std::size_t chunk_size, std::vector<std::vector<std::uint64_t>> offsets)
+    -> std::vector<word_count_map>
+  {
+    std::vector<word_count_map> the_results (num_groups);
+    std::vector<async_task<void>> the_counts;
+    for (auto g = 0u; g < num_groups; ++g)
+      if (!offsets[g].empty ())
+        the_counts.emplace_back (count_group (*m_counters[g], file_path, chunk_size, std::move (offsets[g]), the_results[g]));
+    sync_wait (when_all (std::move (the_counts)));
+    return the_results;
+  }
+
+  static auto count_group (parallel_split_and_reduce<word_count_map>& the_counter, std::filesystem::path file_path,
+      std::size_t chunk_size, std::vector<std::uint64_t> offsets, word_count_map& the_result)
+    -> async_task<void>
+  {
+    the_result = co_await the_counter.apply_to_file_ranges_async (std::move (file_path), chunk_size, std::move (offsets));
+  }
+
+  // Random chunk of [first, last) not sampled yet, last if there is none.
+  auto pick_unsampled (const std::vector<bool>& is_sampled, std::uint64_t first, std::uint64_t last)
+    -> std::uint64_t
+  {
+    if (first >= last)
+      return last;
+    const auto start = std::uniform_int_distribution<std::uint64_t> { first, last - 1u } (m_random);
+    for (auto i = start; i < last; ++i)
+      if (!is_sampled[i])
+        return i;
+    for (auto i = first; i < start; ++i)
+      if (!is_sampled[i])
+        return i;
+    return last;
+  }
+
+  std::vector<std::unique_ptr<parallel_split_and_reduce<word_count_map>>> m_counters;
+  std::mt19937_64                                                         m_random;
+};
@@ -5,6 +5,7 @@
 #include <utility>
 #include <filesystem>
 #include <string_view>
+#include <system_error>
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -68,15 +69,36 @@ struct file_wrapper
     return st.st_size;
   } 
 
+  void resize (uint64_t new_size)
+  {
+    if (ftruncate64 (m_fd, new_size) < 0)
+      throw std::system_error { errno, std::system_category() };
+  }
+
+  // Positional write, safe to call from several threads at disjoint offsets.
+  void write_at (std::string_view data, uint64_t offset)
+  {
+    while (!data.empty ())
+    {
+      const auto written = pwrite64 (m_fd, data.data (), data.size (), offset);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written < 0)
+        throw std::system_error { errno, std::system_category() };
+      data.remove_prefix (written);
+      offset += written;
+    }
+  }
+
   auto map (std::size_t size = 0, std::size_t offset = 0, int prot = PROT_READ, int flags = MAP_PRIVATE)
     -> mmap_wrapper;
 
   template <typename T = std::byte>
-  auto map_span (std::uint64_t begin = 0, std::uint64_t end = 0, int prot = PROT_READ, int flags = MAP_PRIVATE)
+  auto map_span (std::uint64_t begin = 0, std::uint64_t end = 0, int prot = PROT_READ, int flags = MAP_PRIVATE, std::uint64_t file_size = 0)
     -> std::tuple<mmap_wrapper, std::span<T>>;
 
   template <typename T = char>
-  auto map_string_view(uint64_t begin, uint64_t end, int prot = PROT_READ, int flags = MAP_SHARED)  
+  auto map_string_view(uint64_t begin, uint64_t end, int prot = PROT_READ, int flags = MAP_SHARED, uint64_t file_size = 0)  
     -> std::tuple<mmap_wrapper, std::basic_string_view<T>>;
 
 
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <utility>
+#include <string_view>
+#include <unordered_set>
+
+#include "word_hash.hpp"
+#include "memory_tracker.hpp"
+
+// Word set that keeps the word_hash of every key next to it. The hash is
+// computed once (usually by the fused tokenizer) and the container only ever
+// reads it back, so inserts, rehashes and merges never rescan the key bytes,
+// which are compared only when two hashes are equal.
+struct hashed_word_set
+{
+  using string_type = std::basic_string<char, std::char_traits<char>, counting_allocator<char, memory_category::word_sets>>;
+
+  struct hashed_word
+  {
+    string_type   word;
+    std::uint64_t hash;
+  };
+
+  struct hashed_view
+  {
+    std::string_view word;
+    std::uint64_t    hash;
+  };
+
+  struct carried_hash
+  {
+    using is_transparent = void;
+
+    auto operator () (const hashed_word& key) const noexcept -> std::size_t { return key.hash; }
+    auto operator () (const hashed_view& key) const noexcept -> std::size_t { return key.hash; }
+  };
+
+  struct carried_equal
+  {
+    using is_transparent = void;
+
+    template <typename _Lhs, typename _Rhs>
+    auto operator () (const _Lhs& lhs, const _Rhs& rhs) const noexcept -> bool
+    {
+      return lhs.hash == rhs.hash && std::string_view { lhs.word } == std::string_view { rhs.word };
+    }
+  };
+
+  using container_type = std::unordered_set<hashed_word, carried_hash, carried_equal,
+    counting_allocator<hashed_word, memory_category::word_sets>>;
+
+  auto insert (std::string_view word, std::uint64_t hash) -> bool
+  {
+    if (m_words.find (hashed_view { word, hash }) != m_words.end ())
+      return false;
+    m_words.emplace (hashed_word { string_type { word }, hash });
+    return true;
+  }
+
+  auto insert (std::string_view word) -> bool
+  {
+    return insert (word, word_hash::of (word));
+  }
+
+  auto contains (std::string_view word, std::uint64_t hash) const -> bool
+  {
+    return m_words.find (hashed_view { word, hash }) != m_words.end ();
+  }
+
+  void merge (hashed_word_set&& other)
+  {
+    if (other.size () > size ())
+      swap (other);
+    m_words.merge (other.m_words);
+    other.clear ();
+  }
+
+  void merge (hashed_word_set& other)
+  {
+    merge (std::move (other));
+  }
+
+  void clear () noexcept
+  {
+    m_words.clear ();
+  }
+
+  void swap (hashed_word_set& other) noexcept
+  {
+    m_words.swap (other.m_words);
+  }
+
+  auto size () const noexcept -> std::size_t
+  {
+    return m_words.size ();
+  }
+
+  auto empty () const noexcept -> bool
+  {
+    return m_words.empty ();
+  }
+
+  template <typename _Callback>
+  void for_each (_Callback&& callback) const
+  {
+    for (const auto& key : m_words)
+      callback (std::string_view { key.word });
+  }
+
+  // Same as for_each over one of num_parts disjoint slices of the buckets,
+  // the slices can be walked from different threads.
+  template <typename _Callback>
+  void for_each_part (std::size_t part, std::size_t num_parts, _Callback&& callback) const
+  {
+    const auto num_buckets = m_words.bucket_count ();
+    for (auto bucket = part * num_buckets / num_parts; bucket < (part + 1u) * num_buckets / num_parts; ++bucket)
+      for (auto it = m_words.begin (bucket); it != m_words.end (bucket); ++it)
+        callback (std::string_view { it->word });
+  }
+
+private:
+  container_type m_words;
+};
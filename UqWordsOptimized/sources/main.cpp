@@ -12,38 +12,151 @@
 #include <fmt/format.h>
 
 #include "parallel_split_and_reduce.hpp"
+#include "program_args.hpp"
+#include "short_word_set.hpp"
+#include "distinct_estimator.hpp"
+#include "vocabulary_writer.hpp"
 
 auto args_validate_file_path(const auto& args, std::size_t n)
   -> std::filesystem::path
 {
   using namespace fmt;
   using namespace std;
-  const std::filesystem::path file_path { args.at(1) };   
-  if (args.size() < 2)
-    throw runtime_error(format("No file given as argument"s));
+  if (args.size() <= n)
+    throw runtime_error(format("No file given as argument"));
+  const std::filesystem::path file_path { args.at(n) };   
   if (!filesystem::exists(file_path))
-    throw runtime_error(format("File '{}' not found"s, file_path.string()));
+    throw runtime_error(format("File '{}' not found", file_path.string()));
   const auto file_size = filesystem::file_size(file_path);
   if (file_size < 1)
-    throw runtime_error(format("File '{}' is empty!"s, file_path.string()));
+    throw runtime_error(format("File '{}' is empty!", file_path.string()));
   return file_path;
 }
 
-constexpr auto buffer_size = 1024u*1024u ;// 128ull*1024ull*1024ull;
+struct program_options
+{
+  std::filesystem::path file_path;
+  bool use_async_pipeline { false };
+  bool use_prefilter { true };
+  bool print_stats { false };
+  std::size_t max_memory { 0u };
+  std::size_t chunk_size { 1024u*1024u };
+  double estimate_error { 0.0 };
+  std::filesystem::path output_path;
+};
+
+auto args_parse_options(std::vector<std::string_view> args)
+  -> program_options
+{
+  using namespace std;
+  program_options options;
+  vector<std::string_view> positional { args.front() };
+
+  for (std::size_t i = 1u; i < args.size(); ++i)
+  {
+    const auto arg = args[i];
+    if (!arg.starts_with("--"))
+      positional.push_back(arg);
+    else if (arg == "--async")
+      options.use_async_pipeline = true;
+    else if (arg == "--no-prefilter")
+      options.use_prefilter = false;
+    else if (arg == "--stats")
+      options.print_stats = true;
+    else if (arg == "--estimate")
+      options.estimate_error = 0.05;
+    else if (arg.starts_with("--estimate="))
+      options.estimate_error = args_parse_error_bound(arg.substr(11u));
+    else if (const auto value = args_option_value(args, i, "--max-memory"))
+      options.max_memory = args_parse_size(*value);
+    else if (const auto value = args_option_value(args, i, "--output"))
+      options.output_path = *value;
+    else if (const auto value = args_option_value(args, i, "--chunk-size"))
+      options.chunk_size = args_parse_size(*value);
+    else
+      throw runtime_error(fmt::format("Unknown option '{}'", arg));
+  }
+  options.file_path = args_validate_file_path(positional, 1);
+  if (options.estimate_error > 0.0 && !options.output_path.empty())
+    throw runtime_error("--output needs the exact vocabulary, it can not be combined with --estimate");
+  return options;
+}
+
+void print_stats(const auto& widget)
+{
+  constexpr auto mib = 1024.0 * 1024.0;
+  const auto prefilter = widget.prefilter_stats();
+  fmt::print(stderr, "prefilter : {} lookups, {} hits ({:.1f} %), {} bypassed\n",
+    prefilter.lookups, prefilter.hits, prefilter.hit_rate() * 100.0, prefilter.bypassed);
+
+  const auto& memory = memory_tracker::instance();
+  fmt::print(stderr, "memory : peak rss {:.1f} MiB, throttled {} times\n", 
+    memory_tracker::peak_rss() / mib, widget.throttled_count());
+  for (auto i = 0u; i < std::size_t (memory_category::count); ++i)
+  {
+    const auto category = memory_category (i);
+    fmt::print(stderr, "  {} : peak {:.1f} MiB, current {:.1f} MiB\n", 
+      memory_tracker::category_name(category), memory.peak(category) / mib, memory.current(category) / mib);
+  }
+}
+
 constexpr auto task_load_factor = 128u;
 
+// Prints the sampled estimate. When sampling did not get within the error
+// bound early enough, counts the chunks left out and adds the words of the
+// sample instead, so the work already done is not thrown away.
+void print_estimate(auto& widget, const program_options& options)
+{
+  sampled_distinct_counter the_sampler { widget.thread_pool(), task_load_factor };
+  the_sampler.set_memory_budget(options.max_memory);
+  auto the_result = the_sampler.estimate(options.file_path, options.chunk_size, options.estimate_error);
+  const auto& the_estimate = the_result.estimate;
+  const auto the_interval = std::isfinite(the_estimate.upper)
+    ? fmt::format("jackknife interval {:.0f} - {:.0f}", the_estimate.lower, the_estimate.upper)
+    : fmt::format("at least {:.0f}", the_estimate.lower);
+  fmt::print(stderr, "estimate : {:.0f} ({}, GEE {:.0f}, coverage {:.1f} %), {:.1f} % of the file sampled in {} rounds\n",
+    the_estimate.estimate, the_interval, the_estimate.gee, the_estimate.coverage * 100.0,
+    the_result.sampled_fraction * 100.0, the_result.num_rounds);
+  if (the_result.converged)
+  {
+    std::cout << std::llround(the_estimate.estimate) << "\n";
+    return;
+  }
+
+  fmt::print(stderr, "estimate : not within {} % after sampling, counting the rest exactly\n", options.estimate_error * 100.0);
+  auto the_words = sync_wait(widget.apply_to_file_ranges_async(options.file_path, the_result.chunk_size, std::move(the_result.unsampled_offsets)));
+  the_result.sample.for_each([&the_words] (std::string_view word, std::uint64_t) {
+    the_words.insert(word);
+  });
+  std::cout << the_words.size() << "\n";
+}
+
 int main(int argc, char** argv)
 {
   using namespace std;
-  using container_type = unordered_set<string>;
+  using container_type = short_word_set;
 
   try
   {
-    vector<string_view> args{ argv, argv + argc };
-    const auto file_path = args_validate_file_path(args, 1);
+    const auto options = args_parse_options({ argv, argv + argc });
     auto num_threads = std::thread::hardware_concurrency();
     parallel_split_and_reduce<container_type> widget { num_threads, task_load_factor };
-    cout << widget.apply_to_file_at_path(file_path, buffer_size).size() << "\n";
+    widget.enable_prefilter(options.use_prefilter);
+    widget.set_memory_budget(options.max_memory);
+    if (options.estimate_error > 0.0)
+      print_estimate(widget, options);
+    else
+    {
+      const auto the_words = options.use_async_pipeline
+        ? sync_wait(widget.apply_to_file_at_path_async(options.file_path, options.chunk_size))
+        : widget.apply_to_file_at_path(options.file_path, options.chunk_size);
+      cout << the_words.size() << "\n";
+      if (!options.output_path.empty())
+        vocabulary_writer { widget.thread_pool() }.write(the_words, options.output_path);
+    }
+
+    if (options.print_stats)
+      print_stats(widget);
 
     return 0;
   }
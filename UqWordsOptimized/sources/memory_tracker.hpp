@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+#include <sys/resource.h>
+
+enum class memory_category: std::size_t
+{
+  mapped_chunks,
+  word_sets,
+  count
+};
+
+// Process wide byte counters per category, fed by mmap_wrapper and by
+// counting_allocator, read by the producer to enforce the memory budget.
+struct memory_tracker
+{
+  static auto instance () noexcept -> memory_tracker&
+  {
+    static memory_tracker s_instance;
+    return s_instance;
+  }
+
+  void allocate (memory_category category, std::size_t bytes) noexcept
+  {
+    auto& the_counter = m_counters [std::size_t (category)];
+    const auto current = the_counter.current.fetch_add (bytes, std::memory_order::relaxed) + bytes;
+    auto peak = the_counter.peak.load (std::memory_order::relaxed);
+    while (current > peak && !the_counter.peak.compare_exchange_weak (peak, current, std::memory_order::relaxed))
+      ;
+  }
+
+  void release (memory_category category, std::size_t bytes) noexcept
+  {
+    m_counters [std::size_t (category)].current.fetch_sub (bytes, std::memory_order::relaxed);
+  }
+
+  auto current (memory_category category) const noexcept -> std::size_t
+  {
+    return m_counters [std::size_t (category)].current.load (std::memory_order::relaxed);
+  }
+
+  auto peak (memory_category category) const noexcept -> std::size_t
+  {
+    return m_counters [std::size_t (category)].peak.load (std::memory_order::relaxed);
+  }
+
+  auto total () const noexcept -> std::size_t
+  {
+    std::size_t the_total { 0u };
+    for (const auto& the_counter : m_counters)
+      the_total += the_counter.current.load (std::memory_order::relaxed);
+    return the_total;
+  }
+
+  static auto category_name (memory_category category) noexcept -> std::string_view
+  {
+    switch (category)
+    {
+    case memory_category::mapped_chunks: return "mapped chunks";
+    case memory_category::word_sets: return "word sets";
+    default: return "?";
+    }
+  }
+
+  // High water mark of the resident set size of the whole process.
+  static auto peak_rss () noexcept -> std::size_t
+  {
+    struct ::rusage usage {};
+    if (::getrusage (RUSAGE_SELF, &usage) < 0)
+      return 0u;
+    return std::size_t (usage.ru_maxrss) * 1024u;
+  }
+
+private:
+  struct alignas(64) counter_type
+  {
+    std::atomic<std::size_t> current { 0u };
+    std::atomic<std::size_t> peak { 0u };
+  };
+
+  std::array<counter_type, std::size_t (memory_category::count)> m_counters;
+};
+
+template <typename T, memory_category _Category>
+struct counting_allocator
+{
+  using value_type = T;
+
+  template <typename U>
+  struct rebind { using other = counting_allocator<U, _Category>; };
+
+  counting_allocator () noexcept = default;
+
+  template <typename U>
+  counting_allocator (const counting_allocator<U, _Category>&) noexcept {}
+
+  auto allocate (std::size_t n) -> T*
+  {
+    auto the_pointer = std::allocator<T> {}.allocate (n);
+    memory_tracker::instance ().allocate (_Category, n * sizeof (T));
+    return the_pointer;
+  }
+
+  void deallocate (T* the_pointer, std::size_t n) noexcept
+  {
+    memory_tracker::instance ().release (_Category, n * sizeof (T));
+    std::allocator<T> {}.deallocate (the_pointer, n);
+  }
+
+  template <typename U>
+  bool operator == (const counting_allocator<U, _Category>&) const noexcept { return true; }
+};
@@ -8,6 +8,8 @@
 
 #include <sys/mman.h>
 
+#include "memory_tracker.hpp"
+
 
 struct file_wrapper;
 
@@ -20,7 +22,11 @@ struct mmap_wrapper
   mmap_wrapper(void* addr, size_t size) noexcept
   : m_addr { addr },
     m_size { size }
-  {}
+  {
+    if (m_addr != nullptr && m_size != 0) {
+      memory_tracker::instance().allocate(memory_category::mapped_chunks, m_size);
+    }
+  }
 
   mmap_wrapper(mmap_wrapper&& other) noexcept
   : m_addr { std::exchange (other.m_addr, nullptr) },
@@ -44,6 +50,7 @@ struct mmap_wrapper
   {
     if (m_addr != nullptr && m_size != 0) {
       ::munmap(m_addr, m_size);
+      memory_tracker::instance().release(memory_category::mapped_chunks, m_size);
     }    
   }
 
@@ -71,12 +78,14 @@ struct mmap_wrapper
   static auto map(const file_wrapper& file, size_t size = 0, size_t offset = 0, int prot = PROT_READ, int flags = MAP_PRIVATE) 
     -> mmap_wrapper;
 
+  // A file_size of 0 is asked from the file (one fstat per mapping), callers
+  // mapping many ranges of a file pass the size they already know.
   template <typename T = std::byte>
-  static auto map_span(const file_wrapper& file, uint64_t begin, uint64_t end, int prot = PROT_READ, int flags = MAP_PRIVATE) 
+  static auto map_span(const file_wrapper& file, uint64_t begin, uint64_t end, int prot = PROT_READ, int flags = MAP_PRIVATE, uint64_t file_size = 0) 
     -> std::tuple<mmap_wrapper, std::span<T>>;
 
   template <typename T = char>              
-  static auto map_string_view(const file_wrapper& file, uint64_t begin, uint64_t end, int prot = PROT_READ, int flags = MAP_SHARED)  
+  static auto map_string_view(const file_wrapper& file, uint64_t begin, uint64_t end, int prot = PROT_READ, int flags = MAP_SHARED, uint64_t file_size = 0)  
     -> std::tuple<mmap_wrapper, std::basic_string_view<T>>;
        
   static auto alignment_size() noexcept -> size_t
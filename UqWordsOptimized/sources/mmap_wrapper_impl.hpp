@@ -1,6 +1,6 @@
 #pragma once 
 
-auto mmap_wrapper::map(const struct file_wrapper& file, size_t size, size_t offset, int prot, int flags) 
+inline auto mmap_wrapper::map(const struct file_wrapper& file, size_t size, size_t offset, int prot, int flags) 
   -> mmap_wrapper
 {
   size = size ? size : file.size();
@@ -12,7 +12,7 @@ auto mmap_wrapper::map(const struct file_wrapper& file, size_t size, size_t offs
 }
 
 template <typename T>
-auto mmap_wrapper::map_span(const file_wrapper& file, uint64_t begin, uint64_t end, int prot, int flags)  
+auto mmap_wrapper::map_span(const file_wrapper& file, uint64_t begin, uint64_t end, int prot, int flags, uint64_t file_size)  
   -> std::tuple<mmap_wrapper, std::span<T>>
 {
   // I assume this is always power of two
@@ -21,7 +21,7 @@ auto mmap_wrapper::map_span(const file_wrapper& file, uint64_t begin, uint64_t e
   begin *= sizeof(T);
   end *= sizeof(T);
   const auto start_offset = begin & align_mask;
-  const auto end_offset = std::min ((end + align_size - 1) & align_mask, file.size());
+  const auto end_offset = std::min ((end + align_size - 1) & align_mask, file_size ? file_size : file.size());
   const auto length = end_offset - start_offset;
   const auto span_begin = (begin - start_offset)/sizeof(T);
   const auto span_length = (end - begin)/sizeof(T);
@@ -31,10 +31,10 @@ auto mmap_wrapper::map_span(const file_wrapper& file, uint64_t begin, uint64_t e
 }
 
 template <typename T>
-auto mmap_wrapper::map_string_view(const file_wrapper& file, uint64_t begin, uint64_t end, int prot, int flags)  
+auto mmap_wrapper::map_string_view(const file_wrapper& file, uint64_t begin, uint64_t end, int prot, int flags, uint64_t file_size)  
   -> std::tuple<mmap_wrapper, std::basic_string_view<T>>
 {
-  auto [handle, span] = mmap_wrapper::map_span<T>(file, begin, end, prot, flags);
+  auto [handle, span] = mmap_wrapper::map_span<T>(file, begin, end, prot, flags, file_size);
 
   return { std::move (handle), std::basic_string_view<T>{ span.data(), span.size() }};
 }
@@ -9,6 +9,10 @@
 #include "parallel_task_dispatch.hpp"
 #include "chunk_loader.hpp"
 #include "pinned_object.hpp"
+#include "async_task.hpp"
+#include "async_channel.hpp"
+#include "word_stages.hpp"
+#include "word_prefilter.hpp"
 
 template <typename _Reduce_target>
 struct parallel_split_and_reduce: pinned_object
@@ -16,12 +20,55 @@ struct parallel_split_and_reduce: pinned_object
   using reduce_target_type = _Reduce_target;
   using reduce_merge_type = std::tuple<reduce_target_type, reduce_target_type>;
 
+  // Targets that count occurrences (word_count_map) need to see every word.
+  static constexpr bool counts_occurrences = requires { requires reduce_target_type::counts_occurrences; };
+
   parallel_split_and_reduce (std::uint32_t num_threads, std::uint32_t task_load_factor)
-  : m_num_threads { num_threads },
-    m_num_waiting { num_threads * task_load_factor },
-    m_thread_pool { num_threads }
+  : parallel_split_and_reduce { std::make_unique<parallel_task_dispatch> (num_threads), task_load_factor }
+  {}
+
+  // Runs on a thread pool owned by the caller, so several reducers can share it.
+  parallel_split_and_reduce (parallel_task_dispatch& thread_pool, std::uint32_t task_load_factor)
+  : m_num_threads { thread_pool.size () },
+    m_max_in_flight { thread_pool.size () * task_load_factor },
+    m_num_waiting { static_cast<std::ptrdiff_t> (thread_pool.size () * task_load_factor) },
+    m_thread_pool { thread_pool },
+    m_prefilters (thread_pool.size ())
   {}
 
+  // Bytes of mapped chunks plus word sets (as seen by memory_tracker) above
+  // which the producer stops loading and forces merges, zero for no limit.
+  void set_memory_budget(std::size_t max_bytes)
+  {
+    m_memory_budget = max_bytes;
+  }
+
+  // Number of times the producer had to wait because of the memory budget.
+  auto throttled_count() const -> std::size_t
+  {
+    return m_num_throttled;
+  }
+
+  auto thread_pool() -> parallel_task_dispatch&
+  {
+    return m_thread_pool;
+  }
+
+  void enable_prefilter(bool is_enabled)
+  {
+    m_prefilter_enabled = is_enabled;
+  }
+
+  // Summed over all workers, covers the last run.
+  auto prefilter_stats() const
+    -> word_prefilter::stats_type
+  {
+    word_prefilter::stats_type the_stats;
+    for (const auto& the_prefilter : m_prefilters)
+      the_stats += the_prefilter.stats ();
+    return the_stats;
+  }
+
   auto apply_to_file_at_path(std::filesystem::path file_name, std::size_t block_size = 64*1024*1024)  
     -> reduce_target_type
   {
@@ -43,9 +90,10 @@ struct parallel_split_and_reduce: pinned_object
     };
 
 
-    const auto the_chunk_size = block_size & mmap_wrapper::alignment_mask();
+    const auto the_chunk_size = aligned_chunk_size (block_size);
     chunk_loader the_chunk_loader { file_name, the_chunk_size };    
-    reduce_target_type lhs, rhs;    
+    reset_prefilters();
+    m_num_throttled = 0u;
     deque<future<reduce_target_type>> partial_sets;
     vector<reduce_target_type> ready_partial_sets;
 
@@ -58,22 +106,30 @@ struct parallel_split_and_reduce: pinned_object
         ready_partial_sets.emplace_back (partial_sets.front().get());
         partial_sets.pop_front();        
       }
+
+      // Over budget : hold off mapping more chunks and block on the oldest
+      // partial sets instead, which unmaps their chunks and merges them early.
+      while (over_memory_budget() && !partial_sets.empty() && ready_partial_sets.size() < 2)
+      {
+        ++m_num_throttled;
+        ready_partial_sets.emplace_back (partial_sets.front().get());
+        partial_sets.pop_front();
+      }
       
       if (ready_partial_sets.size() > 1)
       {
-        auto the_future = m_thread_pool.async ([this] (auto the_sets) 
-          -> reduce_target_type
-        {
-          m_num_waiting.release();
-          return collapse_mulltiple_sets(the_sets);
-        }, move (ready_partial_sets));
+        partial_sets.emplace_back (merge_partial_sets_async (move (ready_partial_sets)));
+        ready_partial_sets.clear();
         continue;
       }
       
 
       chunk_loader::shared_chunk_type the_chunk;
       if (!(the_chunk = the_chunk_loader.next_shared(' ')))
+      {
+        m_num_waiting.release();
         break;
+      }
       auto the_future = m_thread_pool.async ([this, the_chunk { std::move (the_chunk) }] () ->
         reduce_target_type
       {        
@@ -84,7 +140,7 @@ struct parallel_split_and_reduce: pinned_object
       partial_sets.emplace_back (move (the_future));      
     }
 
-    while(partial_sets.size () > 1 )
+    while(partial_sets.size () + ready_partial_sets.size () > 1)
     {            
       while (ready_partial_sets.size() < 2)
       {
@@ -93,41 +149,249 @@ struct parallel_split_and_reduce: pinned_object
       }
 
       m_num_waiting.acquire();
-      auto the_future = m_thread_pool.async ([this] (auto the_sets) 
-        -> reduce_target_type
-      {
-        m_num_waiting.release();
-        return collapse_mulltiple_sets(the_sets);
-      }, move (ready_partial_sets));
-
-      partial_sets.emplace_back (move (the_future));
-      ready_partial_sets.reserve(10);
+      partial_sets.emplace_back (merge_partial_sets_async (move (ready_partial_sets)));
+      ready_partial_sets.clear();
     } 
+    if (!ready_partial_sets.empty())
+      return move (ready_partial_sets.front());
+    if (partial_sets.empty())
+      return {};
     return partial_sets.back().get();
   }
 
+  // Same reduction as above written as a coroutine pipeline : one producer stage
+  // feeding chunks through a bounded channel into one reduce stage per thread,
+  // followed by a tournament merge of the per-thread sets.
+  template <typename _Word_stage = pass_through_stage>
+  auto apply_to_file_at_path_async(std::filesystem::path file_name, std::size_t block_size = 64*1024*1024, _Word_stage word_stage = {})
+    -> async_task<reduce_target_type>
+  {
+    using namespace std;
+
+    const auto the_chunk_size = aligned_chunk_size (block_size);
+    chunk_loader the_chunk_loader { file_name, the_chunk_size };
+    reset_prefilters();
+    async_channel<chunk_loader::shared_chunk_type> the_chunks { m_thread_pool, channel_capacity (the_chunk_size) };
+    vector<reduce_target_type> the_partial_sets (m_num_threads);
+
+    vector<async_task<void>> the_stages;
+    the_stages.reserve (m_num_threads + 1);
+    the_stages.emplace_back (produce_chunks (the_chunk_loader.async_chunks (' '), the_chunks));
+    for (auto& the_partial_set : the_partial_sets)
+      the_stages.emplace_back (reduce_chunks (the_chunks, the_partial_set, word_stage));
+    co_await when_all (move (the_stages));
+
+    co_return co_await merge_partial_sets (move (the_partial_sets));
+  }
+
+  // Same pipeline over the chunks at the given offsets only (multiples of
+  // aligned_chunk_size (block_size)), each word counted in the chunk it starts in.
+  auto apply_to_file_ranges_async(std::filesystem::path file_name, std::size_t block_size, std::vector<std::uint64_t> offsets)
+    -> async_task<reduce_target_type>
+  {
+    using namespace std;
+
+    const auto the_chunk_size = aligned_chunk_size (block_size);
+    chunk_loader the_chunk_loader { file_name, the_chunk_size };
+    reset_prefilters();
+    async_channel<chunk_loader::shared_chunk_type> the_chunks { m_thread_pool, channel_capacity (the_chunk_size) };
+    vector<reduce_target_type> the_partial_sets (m_num_threads);
+    const pass_through_stage the_word_stage;
+
+    vector<async_task<void>> the_stages;
+    the_stages.reserve (m_num_threads + 1);
+    the_stages.emplace_back (produce_chunks (the_chunk_loader.async_chunks_at (move (offsets), ' '), the_chunks));
+    for (auto& the_partial_set : the_partial_sets)
+      the_stages.emplace_back (reduce_chunks (the_chunks, the_partial_set, the_word_stage));
+    co_await when_all (move (the_stages));
+
+    co_return co_await merge_partial_sets (move (the_partial_sets));
+  }
+
+  // Chunk size actually used for a requested block size, whole pages.
+  static auto aligned_chunk_size(std::size_t block_size)
+    -> std::size_t
+  {
+    return std::max (block_size & mmap_wrapper::alignment_mask(), mmap_wrapper::alignment_size());
+  }
+
   auto reduce_chunk_to_word_set(const chunk_loader::chunk_type& the_chunk)
     -> reduce_target_type
   {
     using namespace std;
     reduce_target_type ws_local;
-    the_chunk.split_into<string> (inserter (ws_local, ws_local.begin ()), ' ');
+    reduce_chunk_into (the_chunk, ws_local, pass_through_stage {});
     return ws_local;
   }
 
+  auto merge_partial_sets_async(std::vector<reduce_target_type> the_sets)
+    -> std::future<reduce_target_type>
+  {
+    return m_thread_pool.async ([this] (auto the_sets) 
+      -> reduce_target_type
+    {
+      m_num_waiting.release();
+      return collapse_mulltiple_sets(the_sets);
+    }, std::move (the_sets));
+  }
+
   auto collapse_mulltiple_sets(std::vector<reduce_target_type>& the_merge)  
     -> reduce_target_type
   {
     reduce_target_type the_result;
     for (auto& item : the_merge)
-      the_result.merge (move (item));
+      the_result.merge (std::move (item));
     return the_result;
   }
 
+  template <typename _Word_stage>
+  void reduce_chunk_into(const chunk_loader::chunk_type& the_chunk, reduce_target_type& the_target, const _Word_stage& word_stage)
+  {
+    using namespace std;
+    if constexpr (is_same_v<_Word_stage, pass_through_stage> && requires { the_target.insert (string_view {}, uint64_t {}); })
+    {
+      const auto the_index = parallel_task_dispatch::current_index ();
+      if (m_prefilter_enabled && !counts_occurrences && the_index < m_prefilters.size ())
+      {
+        auto& the_prefilter = m_prefilters[the_index];
+        the_chunk.for_each_hashed_word ([&the_target, &the_prefilter] (string_view word, uint64_t hash) {
+          if (!the_prefilter.seen (word, hash))
+            the_target.insert (word, hash);
+        }, ' ');
+        return;
+      }
+      the_chunk.for_each_hashed_word ([&the_target] (string_view word, uint64_t hash) {
+        the_target.insert (word, hash);
+      }, ' ');
+    }
+    else
+    {
+      auto emit_word = [&the_target] (auto&& word) {
+        insert_word (the_target, forward<decltype(word)> (word));
+      };
+      the_chunk.for_each_word ([&] (string_view word) {
+        word_stage (word, emit_word);
+      }, ' ');
+    }
+  }
+
+  // Targets that take a string_view directly (such as short_word_set) get the
+  // word without a temporary std::string, targets that also take a precomputed
+  // word_hash get it from the fused tokenizer above when no word stage is set.
+  template <typename _Word_type>
+  static void insert_word(reduce_target_type& the_target, _Word_type&& word)
+  {
+    using namespace std;
+    if constexpr (requires { the_target.insert (string_view { word }); })
+      the_target.insert (string_view { word });
+    else
+      the_target.insert (typename reduce_target_type::value_type (forward<_Word_type> (word)));
+  }
+
+private:
+  parallel_split_and_reduce (std::unique_ptr<parallel_task_dispatch> thread_pool, std::uint32_t task_load_factor)
+  : m_owned_thread_pool { std::move (thread_pool) },
+    m_num_threads { m_owned_thread_pool->size () },
+    m_max_in_flight { m_owned_thread_pool->size () * task_load_factor },
+    m_num_waiting { static_cast<std::ptrdiff_t> (m_owned_thread_pool->size () * task_load_factor) },
+    m_thread_pool { *m_owned_thread_pool },
+    m_prefilters (m_owned_thread_pool->size ())
+  {}
+
+  bool over_memory_budget() const
+  {
+    return m_memory_budget != 0u && memory_tracker::instance().total() > m_memory_budget;
+  }
+
+  // The coroutine pipeline holds at most capacity + num_threads chunks, keep
+  // them within half of the memory budget, the rest is left for the word sets.
+  auto channel_capacity(std::size_t the_chunk_size) const
+    -> std::size_t
+  {
+    if (m_memory_budget == 0u)
+      return m_max_in_flight;
+    const auto the_chunks = m_memory_budget / 2u / std::max<std::size_t> (the_chunk_size, 1u);
+    return std::clamp<std::size_t> (the_chunks > m_num_threads ? the_chunks - m_num_threads : 0u, 1u, m_max_in_flight);
+  }
+
+  // Prefilter entries only prove a word went into a set of the same run.
+  void reset_prefilters()
+  {
+    for (auto& the_prefilter : m_prefilters)
+      the_prefilter.reset ();
+  }
+
+  auto produce_chunks(async_generator<chunk_loader::shared_chunk_type> the_generator, async_channel<chunk_loader::shared_chunk_type>& the_chunks)
+    -> async_task<void>
+  {
+    co_await m_thread_pool.schedule ();
+    try
+    {
+      while (auto the_chunk = co_await the_generator.next ())
+      {
+        if (!co_await the_chunks.push (std::move (*the_chunk)))
+          break;
+      }
+    }
+    catch (...)
+    {
+      the_chunks.close ();
+      throw;
+    }
+    the_chunks.close ();
+  }
+
+  template <typename _Word_stage>
+  auto reduce_chunks(async_channel<chunk_loader::shared_chunk_type>& the_chunks, reduce_target_type& the_target, const _Word_stage& word_stage)
+    -> async_task<void>
+  {
+    co_await m_thread_pool.schedule ();
+    try
+    {
+      while (auto the_chunk = co_await the_chunks.pop ())
+        reduce_chunk_into (**the_chunk, the_target, word_stage);
+    }
+    catch (...)
+    {
+      // Otherwise the producer can block on a full channel nobody drains.
+      the_chunks.close ();
+      throw;
+    }
+  }
+
+  auto merge_partial_sets(std::vector<reduce_target_type> the_sets)
+    -> async_task<reduce_target_type>
+  {
+    using namespace std;
+    for (auto stride = 1u; stride < the_sets.size (); stride *= 2u)
+    {
+      vector<async_task<void>> the_merges;
+      for (auto i = 0u; i + stride < the_sets.size (); i += 2u * stride)
+        the_merges.emplace_back (merge_into (the_sets[i], the_sets[i + stride]));
+      co_await when_all (move (the_merges));
+    }
+    co_return move (the_sets.front ());
+  }
+
+  auto merge_into(reduce_target_type& the_target, reduce_target_type& the_source)
+    -> async_task<void>
+  {
+    co_await m_thread_pool.schedule ();
+    if (the_target.size () < the_source.size ())
+      std::swap (the_target, the_source);
+    the_target.merge (std::move (the_source));
+  }
+
 private:
   using semaphore_type = std::counting_semaphore<>;
 
+  std::unique_ptr<parallel_task_dispatch> m_owned_thread_pool;
   const std::size_t m_num_threads;
+  const std::size_t m_max_in_flight;
   semaphore_type m_num_waiting;
-  parallel_task_dispatch m_thread_pool;
+  parallel_task_dispatch& m_thread_pool;
+  std::vector<word_prefilter> m_prefilters;
+  bool m_prefilter_enabled { true };
+  std::size_t m_memory_budget { 0u };
+  std::size_t m_num_throttled { 0u };
 };
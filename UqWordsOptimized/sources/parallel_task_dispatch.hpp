@@ -4,6 +4,10 @@
 #include <mutex>
 #include <future>
 #include <type_traits>
+#include <functional>
+#include <iostream>
+#include <cassert>
+#include <coroutine>
 //#include <ranges>
 
 #include "concurrent_queue.hpp"
@@ -29,7 +33,10 @@ struct parallel_task_dispatch: pinned_object
 
  ~parallel_task_dispatch()
   {
+    // Workers have to be joined before the queues they wait on go away.
     m_breaks.request_stop();
+    std::for_each_n (m_queues.get(), m_count, [] (auto& queue) { queue.done(); });
+    std::for_each_n (m_handles.get(), m_count, [] (auto& handle) { handle.join(); });
   }
 
   template <typename Task_type>
@@ -73,6 +80,25 @@ struct parallel_task_dispatch: pinned_object
     return task_future;
   }
 
+  // Awaitable that moves the awaiting coroutine onto one of the worker threads.
+  auto schedule ()
+  {
+    struct awaiter
+    {
+      bool await_ready () const noexcept { return false; }
+
+      void await_suspend (std::coroutine_handle<> handle)
+      {
+        m_thread_pool.enqueue ([handle] (std::size_t) { handle.resume (); });
+      }
+
+      void await_resume () const noexcept {}
+
+      parallel_task_dispatch& m_thread_pool;
+    };
+    return awaiter { *this };
+  }
+
   void wait_for_all()
   {
     for(auto i = 0; i < m_count; ++i)
@@ -84,10 +110,24 @@ struct parallel_task_dispatch: pinned_object
     return m_active.load(std::memory_order::acquire);
   }
 
+  auto size() const noexcept -> std::size_t
+  {
+    return m_count;
+  }
+
+  // Index of the worker running the calling thread, npos outside of the pool.
+  static auto current_index() noexcept -> std::size_t
+  {
+    return s_current_index;
+  }
+
+  static constexpr auto npos = ~std::size_t { 0u };
+
 private:
   void perform_tasks(const std::stop_token& stop_token, std::size_t index)
   {
     const auto number_of_iteration = m_spins * m_count;
+    s_current_index = index;
     
     while (!stop_token.stop_requested())
     {
@@ -115,6 +155,8 @@ private:
   }
 
 private:
+  static inline thread_local std::size_t s_current_index { npos };
+
   std::size_t                       m_count;
   std::size_t                       m_spins;
   std::atomic<std::size_t>          m_index;
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <charconv>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+#include <fmt/format.h>
+
+// Parses sizes like 4096, 512K, 64M or 2G (powers of 1024).
+inline auto args_parse_size(std::string_view arg)
+  -> std::size_t
+{
+  using namespace std;
+  size_t value { 0u };
+  const auto [tail, error] = from_chars(arg.data(), arg.data() + arg.size(), value);
+  if (error != errc{} || tail == arg.data())
+    throw runtime_error(fmt::format("Invalid size '{}'", arg));
+  const auto suffix = string_view { tail, arg.data() + arg.size() };
+  if (suffix.empty()) 
+    return value;
+  if (suffix == "K" || suffix == "k")
+    return value << 10u;
+  if (suffix == "M" || suffix == "m")
+    return value << 20u;
+  if (suffix == "G" || suffix == "g")
+    return value << 30u;
+  throw runtime_error(fmt::format("Invalid size '{}'", arg));
+}
+
+// Parses a relative error bound such as 0.05, strictly between 0 and 1.
+inline auto args_parse_error_bound(std::string_view arg)
+  -> double
+{
+  using namespace std;
+  double value { 0.0 };
+  const auto [tail, error] = from_chars(arg.data(), arg.data() + arg.size(), value);
+  if (error != errc{} || tail == arg.data() || tail != arg.data() + arg.size() || !(value > 0.0 && value < 1.0))
+    throw runtime_error(fmt::format("Invalid error bound '{}'", arg));
+  return value;
+}
+
+// Value of option `name` at args[i], given as "--name=value" or as "--name value"
+// (then i moves past the value). Empty if args[i] is some other option, only the
+// exact name matches, "--name-other" or "--nameother" do not.
+inline auto args_option_value(std::span<const std::string_view> args, std::size_t& i, std::string_view name)
+  -> std::optional<std::string_view>
+{
+  using namespace std;
+  const auto arg = args[i];
+  if (!arg.starts_with(name))
+    return nullopt;
+  if (arg.size() > name.size())
+  {
+    if (arg[name.size()] != '=')
+      return nullopt;
+    return arg.substr(name.size() + 1u);
+  }
+  if (i + 1u >= args.size())
+    throw runtime_error(fmt::format("Option '{}' requires a value", name));
+  return args[++i];
+}
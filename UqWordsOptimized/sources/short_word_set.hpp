@@ -0,0 +1,233 @@
+#pragma once
+
+#include <bit>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <string_view>
+
+#include "word_hash.hpp"
+#include "hashed_word_set.hpp"
+#include "memory_tracker.hpp"
+
+// Word set specialized for short words. Words of up to 16 bytes are kept inline
+// as two integers in an open addressing table, compared with plain integer
+// compares and hashed with the fixed width word_hash::of_short, only longer
+// words go to the overflow hashed_word_set.
+struct short_word_set
+{
+  static constexpr std::size_t max_short_length = 16u;
+
+  short_word_set () = default;
+
+  auto insert (std::string_view word) -> bool
+  {
+    if (word.size () > max_short_length || word.empty ())
+      return m_overflow.insert (word);
+
+    auto the_slot = make_slot (word);
+    the_slot.meta = make_meta (word_hash::of_short (the_slot.lo, the_slot.hi, word.size ()), word.size ());
+    return insert_slot (the_slot);
+  }
+
+  // Takes a hash already computed with word_hash (e.g. by the fused tokenizer).
+  auto insert (std::string_view word, std::uint64_t hash) -> bool
+  {
+    if (word.size () > max_short_length || word.empty ())
+      return m_overflow.insert (word, hash);
+
+    auto the_slot = make_slot (word);
+    the_slot.meta = make_meta (hash, word.size ());
+    return insert_slot (the_slot);
+  }
+
+  auto contains (std::string_view word) const -> bool
+  {
+    const auto hash = word_hash::of (word);
+    if (word.size () > max_short_length || word.empty ())
+      return m_overflow.contains (word, hash);
+    if (m_slots.empty ())
+      return false;
+
+    auto the_slot = make_slot (word);
+    the_slot.meta = make_meta (hash, word.size ());
+    const auto mask = m_slots.size () - 1u;
+    for (auto index = the_slot.meta >> m_shift; ; index = (index + 1u) & mask)
+    {
+      const auto& current = m_slots [index];
+      if (current.meta == 0u)
+        return false;
+      if (current.meta == the_slot.meta && current.lo == the_slot.lo && current.hi == the_slot.hi)
+        return true;
+    }
+  }
+
+  auto emplace (std::string_view word) -> bool
+  {
+    return insert (word);
+  }
+
+  // Moves every word of the other set into this one, the other set is left empty.
+  void merge (short_word_set&& other)
+  {
+    if (other.size () > size ())
+      swap (other);
+    reserve (m_count + other.m_count);
+    for (const auto& the_slot : other.m_slots)
+      if (the_slot.meta != 0u)
+        insert_slot (the_slot);
+    m_overflow.merge (other.m_overflow);
+    other.clear ();
+  }
+
+  void merge (short_word_set& other)
+  {
+    merge (std::move (other));
+  }
+
+  void reserve (std::size_t count)
+  {
+    auto capacity = std::max<std::size_t> (min_capacity, std::bit_ceil (count + count / 2u + 1u));
+    if (capacity > m_slots.size ())
+      rehash (capacity);
+  }
+
+  void clear ()
+  {
+    m_slots.clear ();
+    m_shift = 64u;
+    m_count = 0u;
+    m_overflow.clear ();
+  }
+
+  void swap (short_word_set& other) noexcept
+  {
+    std::swap (m_slots, other.m_slots);
+    std::swap (m_shift, other.m_shift);
+    std::swap (m_count, other.m_count);
+    std::swap (m_overflow, other.m_overflow);
+  }
+
+  auto size () const noexcept -> std::size_t
+  {
+    return m_count + m_overflow.size ();
+  }
+
+  auto empty () const noexcept -> bool
+  {
+    return size () == 0u;
+  }
+
+  // Invokes callback with a string_view of every word in the set, views of
+  // short words only stay valid for the duration of the call.
+  template <typename _Callback>
+  void for_each (_Callback&& callback) const
+  {
+    for (const auto& the_slot : m_slots)
+    {
+      if (the_slot.meta == 0u)
+        continue;
+      char bytes [max_short_length];
+      std::memcpy (bytes, &the_slot.lo, 8u);
+      std::memcpy (bytes + 8u, &the_slot.hi, 8u);
+      callback (std::string_view { bytes, length_of (the_slot.meta) });
+    }
+    m_overflow.for_each (callback);
+  }
+
+  // Same as for_each over one of num_parts disjoint slices of the set, the
+  // slices can be walked from different threads.
+  template <typename _Callback>
+  void for_each_part (std::size_t part, std::size_t num_parts, _Callback&& callback) const
+  {
+    const auto first = part * m_slots.size () / num_parts;
+    const auto last = (part + 1u) * m_slots.size () / num_parts;
+    for (auto index = first; index < last; ++index)
+    {
+      const auto& the_slot = m_slots [index];
+      if (the_slot.meta == 0u)
+        continue;
+      char bytes [max_short_length];
+      std::memcpy (bytes, &the_slot.lo, 8u);
+      std::memcpy (bytes + 8u, &the_slot.hi, 8u);
+      callback (std::string_view { bytes, length_of (the_slot.meta) });
+    }
+    m_overflow.for_each_part (part, num_parts, callback);
+  }
+
+private:
+  struct slot_type
+  {
+    std::uint64_t lo   { 0u };
+    std::uint64_t hi   { 0u };
+    std::uint64_t meta { 0u };
+  };
+
+  using slot_vector_type = std::vector<slot_type, counting_allocator<slot_type, memory_category::word_sets>>;
+
+  static constexpr std::size_t min_capacity = 64u;
+
+  // Top 56 bits of the hash with the word length in the low byte, a zero
+  // length marks an empty slot, the index is taken from the top bits so it
+  // can always be recovered from meta without rehashing the word.
+  static auto make_slot (std::string_view word) noexcept
+    -> slot_type
+  {
+    char bytes [max_short_length] {};
+    std::memcpy (bytes, word.data (), word.size ());
+    slot_type the_slot;
+    std::memcpy (&the_slot.lo, bytes, 8u);
+    std::memcpy (&the_slot.hi, bytes + 8u, 8u);
+    return the_slot;
+  }
+
+  static constexpr auto make_meta (std::uint64_t hash, std::size_t length) noexcept
+    -> std::uint64_t
+  {
+    return (hash & ~std::uint64_t { 0xffu }) | length;
+  }
+
+  static constexpr auto length_of (std::uint64_t meta) noexcept
+    -> std::size_t
+  {
+    return meta & 0xffu;
+  }
+
+  auto insert_slot (const slot_type& the_slot) -> bool
+  {
+    if ((m_count + 1u) * 4u > m_slots.size () * 3u)
+      rehash (std::max (min_capacity, m_slots.size () * 2u));
+
+    const auto mask = m_slots.size () - 1u;
+    for (auto index = the_slot.meta >> m_shift; ; index = (index + 1u) & mask)
+    {
+      auto& current = m_slots [index];
+      if (current.meta == 0u)
+      {
+        current = the_slot;
+        ++m_count;
+        return true;
+      }
+      if (current.meta == the_slot.meta && current.lo == the_slot.lo && current.hi == the_slot.hi)
+        return false;
+    }
+  }
+
+  void rehash (std::size_t capacity)
+  {
+    auto old_slots = std::exchange (m_slots, slot_vector_type (capacity));
+    m_shift = 64u - std::countr_zero (capacity);
+    m_count = 0u;
+    for (const auto& the_slot : old_slots)
+      if (the_slot.meta != 0u)
+        insert_slot (the_slot);
+  }
+
+private:
+  slot_vector_type                m_slots;
+  std::uint32_t                   m_shift { 64u };
+  std::size_t                     m_count { 0u };
+  hashed_word_set                 m_overflow;
+};
@@ -0,0 +1,128 @@
+#include <map>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+
+#include "uqwords.hpp"
+#include "parallel_split_and_reduce.hpp"
+#include "short_word_set.hpp"
+#include "word_count_map.hpp"
+
+namespace uqwords
+{
+  struct engine::impl
+  {
+    struct indexed_file
+    {
+      std::filesystem::file_time_type last_write_time;
+      std::uintmax_t                  file_size;
+      short_word_set                  vocabulary;
+    };
+
+    impl (const engine_options& options)
+    : m_options { options },
+      m_thread_pool { options.num_threads ? options.num_threads : std::max (1u, std::thread::hardware_concurrency ()) },
+      m_unique { m_thread_pool, static_cast<std::uint32_t> (options.task_load_factor) },
+      m_counter { m_thread_pool, static_cast<std::uint32_t> (options.task_load_factor) }
+    {
+      m_unique.enable_prefilter (options.use_prefilter);
+      m_unique.set_memory_budget (options.max_memory);
+      m_counter.set_memory_budget (options.max_memory);
+    }
+
+    auto find_fresh_index (const std::filesystem::path& file_path)
+      -> indexed_file*
+    {
+      auto it = m_indexes.find (std::filesystem::weakly_canonical (file_path));
+      if (it == m_indexes.end ())
+        return nullptr;
+      if (it->second.last_write_time != std::filesystem::last_write_time (file_path)
+       || it->second.file_size != std::filesystem::file_size (file_path))
+      {
+        m_indexes.erase (it);
+        return nullptr;
+      }
+      return &it->second;
+    }
+
+    auto build_index (const std::filesystem::path& file_path)
+      -> indexed_file&
+    {
+      if (auto* the_index = find_fresh_index (file_path))
+        return *the_index;
+      indexed_file the_index
+      {
+        std::filesystem::last_write_time (file_path),
+        std::filesystem::file_size (file_path),
+        sync_wait (m_unique.apply_to_file_at_path_async (file_path, m_options.chunk_size))
+      };
+      auto [it, _] = m_indexes.insert_or_assign (std::filesystem::weakly_canonical (file_path), std::move (the_index));
+      return it->second;
+    }
+
+    engine_options                                  m_options;
+    std::mutex                                      m_mutex;
+    parallel_task_dispatch                          m_thread_pool;
+    parallel_split_and_reduce<short_word_set>       m_unique;
+    parallel_split_and_reduce<word_count_map>       m_counter;
+    std::map<std::filesystem::path, indexed_file>   m_indexes;
+  };
+
+  engine::engine (engine_options options)
+  : m_impl { std::make_unique<impl> (options) }
+  {}
+
+  engine::~engine () = default;
+
+  auto engine::count_unique (const std::filesystem::path& file_path) -> std::uint64_t
+  {
+    std::unique_lock hold_lock { m_impl->m_mutex };
+    if (auto* the_index = m_impl->find_fresh_index (file_path))
+      return the_index->vocabulary.size ();
+    return sync_wait (m_impl->m_unique.apply_to_file_at_path_async (file_path, m_impl->m_options.chunk_size)).size ();
+  }
+
+  auto engine::top_k (const std::filesystem::path& file_path, std::size_t k) -> std::vector<word_count>
+  {
+    if (k == 0u)
+      return {};
+    std::unique_lock hold_lock { m_impl->m_mutex };
+    const auto the_counts = sync_wait (m_impl->m_counter.apply_to_file_at_path_async (file_path, m_impl->m_options.chunk_size));
+
+    std::vector<std::pair<std::string_view, std::uint64_t>> the_entries;
+    the_entries.reserve (the_counts.size ());
+    the_counts.for_each ([&the_entries] (std::string_view word, std::uint64_t count) {
+      the_entries.emplace_back (word, count);
+    });
+
+    const auto the_top = std::min (k, the_entries.size ());
+    std::partial_sort (the_entries.begin (), the_entries.begin () + the_top, the_entries.end (),
+      [] (const auto& lhs, const auto& rhs) {
+        return lhs.second != rhs.second ? lhs.second > rhs.second : lhs.first < rhs.first;
+      });
+
+    std::vector<word_count> the_result;
+    the_result.reserve (the_top);
+    for (auto i = 0u; i < the_top; ++i)
+      the_result.push_back ({ std::string { the_entries[i].first }, the_entries[i].second });
+    return the_result;
+  }
+
+  auto engine::index (const std::filesystem::path& file_path) -> std::uint64_t
+  {
+    std::unique_lock hold_lock { m_impl->m_mutex };
+    return m_impl->build_index (file_path).vocabulary.size ();
+  }
+
+  auto engine::lookup (const std::filesystem::path& file_path, std::string_view word) -> bool
+  {
+    std::unique_lock hold_lock { m_impl->m_mutex };
+    return m_impl->build_index (file_path).vocabulary.contains (word);
+  }
+
+  auto engine::drop_index (const std::filesystem::path& file_path) -> bool
+  {
+    std::unique_lock hold_lock { m_impl->m_mutex };
+    return m_impl->m_indexes.erase (std::filesystem::weakly_canonical (file_path)) > 0u;
+  }
+}
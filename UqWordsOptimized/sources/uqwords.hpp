@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+
+// Public interface of the uqwords library. Only standard headers are exposed,
+// the templates behind it live in uqwords.cpp, so callers only relink when the
+// implementation changes.
+namespace uqwords
+{
+  struct engine_options
+  {
+    std::size_t num_threads { 0u };           // 0 : one per hardware thread
+    std::size_t task_load_factor { 128u };
+    std::size_t chunk_size { 1024u*1024u };
+    std::size_t max_memory { 0u };            // 0 : no budget
+    bool        use_prefilter { true };
+  };
+
+  struct word_count
+  {
+    std::string   word;
+    std::uint64_t count;
+  };
+
+  // Keeps a warm thread pool across calls. Calls are serialized, each one
+  // uses the whole pool.
+  struct engine
+  {
+    explicit engine (engine_options options = {});
+   ~engine ();
+
+    engine (const engine&) = delete;
+    engine& operator = (const engine&) = delete;
+
+    // Number of distinct words, answered from the index when it is up to date.
+    auto count_unique (const std::filesystem::path& file_path) -> std::uint64_t;
+
+    // The k most frequent words, most frequent first, ties in byte order.
+    // Always reads the whole file, the index only keeps the vocabulary, not
+    // how often each word occurs.
+    auto top_k (const std::filesystem::path& file_path, std::size_t k) -> std::vector<word_count>;
+
+    // Builds (or refreshes, if the file changed) the in-memory vocabulary
+    // of the file and returns its number of distinct words.
+    auto index (const std::filesystem::path& file_path) -> std::uint64_t;
+
+    // Looks the word up in the index of the file, building it if needed.
+    auto lookup (const std::filesystem::path& file_path, std::string_view word) -> bool;
+
+    // Forgets the index of the file, returns false if there was none.
+    auto drop_index (const std::filesystem::path& file_path) -> bool;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> m_impl;
+  };
+}
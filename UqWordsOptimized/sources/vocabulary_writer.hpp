@@ -0,0 +1,184 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <future>
+#include <cstdint>
+#include <exception>
+#include <algorithm>
+#include <filesystem>
+#include <string_view>
+
+#include "file_wrapper.hpp"
+#include "parallel_task_dispatch.hpp"
+
+// Writes the words of a set to a file, one per line, sorted by bytes. Every
+// step runs on the thread pool :
+//
+//   1. each worker copies one slice of the set (for_each_part) into its own
+//      arena and counts its words per bucket of the first two bytes,
+//   2. the bucket counts of all workers give every word its place, each worker
+//      scatters views of its arena to those places (first MSD radix pass),
+//   3. runs of whole buckets of about the same number of words are sorted,
+//   4. the byte size of each run gives its offset in the file and the runs
+//      are written concurrently with positional writes.
+struct vocabulary_writer
+{
+  // One bucket per first byte and second byte or end of word.
+  static constexpr std::size_t num_buckets = 256u * 257u;
+  static constexpr std::size_t write_buffer_size = 1024u * 1024u;
+  static constexpr std::size_t runs_per_thread = 8u;
+
+  vocabulary_writer (parallel_task_dispatch& thread_pool)
+  : m_thread_pool { thread_pool }
+  {}
+
+  // Returns the number of bytes written.
+  template <typename _Word_set>
+  auto write (const _Word_set& the_set, const std::filesystem::path& file_path)
+    -> std::uint64_t
+  {
+    using namespace std;
+    const auto num_parts = m_thread_pool.size ();
+
+    vector<gathered_part> the_parts (num_parts);
+    wait_for_all (num_parts, [&] (size_t part) {
+      auto& the_part = the_parts [part];
+      the_part.bucket_starts.assign (num_buckets, 0u);
+      the_set.for_each_part (part, num_parts, [&the_part] (std::string_view word) {
+        the_part.bytes.append (word);
+        the_part.ends.push_back (the_part.bytes.size ());
+        ++the_part.bucket_starts [bucket_of (word)];
+      });
+    });
+
+    // Bucket major, part minor, so the parts fill each bucket side by side.
+    vector<size_t> the_bucket_starts (num_buckets + 1u);
+    size_t the_position { 0u };
+    for (auto bucket = 0u; bucket < num_buckets; ++bucket)
+    {
+      the_bucket_starts [bucket] = the_position;
+      for (auto& the_part : the_parts)
+        the_position += exchange (the_part.bucket_starts [bucket], the_position);
+    }
+    the_bucket_starts [num_buckets] = the_position;
+
+    vector<std::string_view> the_words (the_position);
+    wait_for_all (num_parts, [&] (size_t part) {
+      auto& the_part = the_parts [part];
+      size_t the_begin { 0u };
+      for (const auto the_end : the_part.ends)
+      {
+        const auto word = std::string_view { the_part.bytes }.substr (the_begin, the_end - the_begin);
+        the_words [the_part.bucket_starts [bucket_of (word)]++] = word;
+        the_begin = the_end;
+      }
+    });
+
+    const auto the_runs = split_into_runs (the_bucket_starts, the_words.size ());
+    vector<uint64_t> the_run_offsets (the_runs.size () + 1u, 0u);
+    wait_for_all (the_runs.size (), [&] (size_t run) {
+      uint64_t the_bytes { 0u };
+      for (auto bucket = the_runs [run].first; bucket < the_runs [run].second; ++bucket)
+      {
+        const auto first = the_words.begin () + the_bucket_starts [bucket];
+        const auto last = the_words.begin () + the_bucket_starts [bucket + 1u];
+        if (last - first > 1)
+          std::sort (first, last);
+        for (auto it = first; it != last; ++it)
+          the_bytes += it->size () + 1u;
+      }
+      the_run_offsets [run + 1u] = the_bytes;
+    });
+    for (auto run = 0u; run < the_runs.size (); ++run)
+      the_run_offsets [run + 1u] += the_run_offsets [run];
+
+    auto the_file = file_wrapper::create (file_path, 0644);
+    the_file.resize (the_run_offsets.back ());
+    wait_for_all (the_runs.size (), [&] (size_t run) {
+      std::string the_buffer;
+      the_buffer.reserve (write_buffer_size);
+      auto the_offset = the_run_offsets [run];
+      const auto first = the_bucket_starts [the_runs [run].first];
+      const auto last = the_bucket_starts [the_runs [run].second];
+      for (auto index = first; index < last; ++index)
+      {
+        if (the_buffer.size () + the_words [index].size () + 1u > write_buffer_size && !the_buffer.empty ())
+        {
+          the_file.write_at (the_buffer, the_offset);
+          the_offset += the_buffer.size ();
+          the_buffer.clear ();
+        }
+        the_buffer.append (the_words [index]);
+        the_buffer.push_back ('\n');
+      }
+      the_file.write_at (the_buffer, the_offset);
+    });
+    return the_run_offsets.back ();
+  }
+
+private:
+  struct gathered_part
+  {
+    std::string              bytes;
+    std::vector<std::size_t> ends;
+    std::vector<std::size_t> bucket_starts;
+  };
+
+  // Words that end after the first byte sort before any longer word with the
+  // same first byte, hence the extra second byte value.
+  static auto bucket_of (std::string_view word) noexcept
+    -> std::size_t
+  {
+    if (word.empty ())
+      return 0u;
+    const auto first = static_cast<std::uint8_t> (word [0]);
+    const auto second = word.size () > 1u ? static_cast<std::uint8_t> (word [1]) + 1u : 0u;
+    return first * 257u + second;
+  }
+
+  // Consecutive bucket ranges [first, second) of roughly equal word counts.
+  auto split_into_runs (const std::vector<std::size_t>& the_bucket_starts, std::size_t num_words) const
+    -> std::vector<std::pair<std::size_t, std::size_t>>
+  {
+    const auto the_target = std::max<std::size_t> (num_words / (m_thread_pool.size () * runs_per_thread), 1u);
+    std::vector<std::pair<std::size_t, std::size_t>> the_runs;
+    std::size_t first { 0u };
+    for (auto bucket = 1u; bucket <= num_buckets; ++bucket)
+    {
+      if (bucket == num_buckets || the_bucket_starts [bucket] - the_bucket_starts [first] >= the_target)
+      {
+        the_runs.emplace_back (first, bucket);
+        first = bucket;
+      }
+    }
+    return the_runs;
+  }
+
+  template <typename _Task>
+  void wait_for_all (std::size_t num_tasks, _Task&& task)
+  {
+    std::vector<std::future<void>> the_futures;
+    the_futures.reserve (num_tasks);
+    for (auto index = 0u; index < num_tasks; ++index)
+      the_futures.emplace_back (m_thread_pool.async ([&task, index] { task (index); }));
+    // Every task has to be done before the state it refers to goes away.
+    std::exception_ptr the_exception;
+    for (auto& the_future : the_futures)
+    {
+      try
+      {
+        the_future.get ();
+      }
+      catch (...)
+      {
+        if (!the_exception)
+          the_exception = std::current_exception ();
+      }
+    }
+    if (the_exception)
+      std::rethrow_exception (the_exception);
+  }
+
+  parallel_task_dispatch& m_thread_pool;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <string_view>
+#include <unordered_map>
+
+#include "word_hash.hpp"
+#include "hashed_word_set.hpp"
+#include "memory_tracker.hpp"
+
+// Reduce target that counts occurrences of every word instead of only keeping
+// the distinct ones, keys carry their word_hash like in hashed_word_set and
+// merging sums the counts.
+struct word_count_map
+{
+  // Every occurrence matters, parallel_split_and_reduce must not prefilter repeats.
+  static constexpr bool counts_occurrences = true;
+
+  using hashed_word = hashed_word_set::hashed_word;
+  using hashed_view = hashed_word_set::hashed_view;
+  using container_type = std::unordered_map<hashed_word, std::uint64_t,
+    hashed_word_set::carried_hash, hashed_word_set::carried_equal,
+    counting_allocator<std::pair<const hashed_word, std::uint64_t>, memory_category::word_sets>>;
+
+  auto insert (std::string_view word, std::uint64_t hash, std::uint64_t count = 1u) -> bool
+  {
+    if (auto it = m_counts.find (hashed_view { word, hash }); it != m_counts.end ())
+    {
+      it->second += count;
+      return false;
+    }
+    m_counts.emplace (hashed_word { hashed_word_set::string_type { word }, hash }, count);
+    return true;
+  }
+
+  auto insert (std::string_view word) -> bool
+  {
+    return insert (word, word_hash::of (word));
+  }
+
+  // Occurrences of the word, zero if it was never inserted.
+  auto count (std::string_view word, std::uint64_t hash) const -> std::uint64_t
+  {
+    const auto it = m_counts.find (hashed_view { word, hash });
+    return it != m_counts.end () ? it->second : 0u;
+  }
+
+  void merge (word_count_map&& other)
+  {
+    if (other.size () > size ())
+      swap (other);
+    for (auto it = other.m_counts.begin (); it != other.m_counts.end (); )
+    {
+      auto current = it++;
+      if (auto found = m_counts.find (current->first); found != m_counts.end ())
+        found->second += current->second;
+      else
+        m_counts.insert (other.m_counts.extract (current));
+    }
+    other.clear ();
+  }
+
+  void merge (word_count_map& other)
+  {
+    merge (std::move (other));
+  }
+
+  void clear () noexcept
+  {
+    m_counts.clear ();
+  }
+
+  void swap (word_count_map& other) noexcept
+  {
+    m_counts.swap (other.m_counts);
+  }
+
+  auto size () const noexcept -> std::size_t
+  {
+    return m_counts.size ();
+  }
+
+  auto empty () const noexcept -> bool
+  {
+    return m_counts.empty ();
+  }
+
+  // Invokes callback with (word, count) for every distinct word.
+  template <typename _Callback>
+  void for_each (_Callback&& callback) const
+  {
+    for (const auto& [key, count] : m_counts)
+      callback (std::string_view { key.word }, count);
+  }
+
+private:
+  container_type m_counts;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+// Block-wise 64-bit word hash. Bytes are consumed in 8 byte little-endian blocks,
+// the last one zero padded, so words of up to 16 bytes packed into two integers
+// hash to exactly the same value as the same bytes viewed as a string.
+struct word_hash
+{
+  static_assert (std::endian::native == std::endian::little, "word_hash assumes little-endian blocks");
+
+  static constexpr std::uint64_t seed = 0x243f6a8885a308d3ull;
+
+  static constexpr auto step (std::uint64_t state, std::uint64_t block) noexcept
+    -> std::uint64_t
+  {
+    state ^= block;
+    state *= 0x9e3779b97f4a7c15ull;
+    return std::rotl (state, 29);
+  }
+
+  static constexpr auto finish (std::uint64_t state, std::size_t length) noexcept
+    -> std::uint64_t
+  {
+    // murmur3 fmix64
+    state ^= length;
+    state ^= state >> 33;
+    state *= 0xff51afd7ed558ccdull;
+    state ^= state >> 33;
+    state *= 0xc4ceb9fe1a85ec53ull;
+    state ^= state >> 33;
+    return state;
+  }
+
+  static auto load_block (const char* bytes, std::size_t length) noexcept
+    -> std::uint64_t
+  {
+    std::uint64_t block { 0 };
+    std::memcpy (&block, bytes, length < 8u ? length : 8u);
+    return block;
+  }
+
+  static auto of (std::string_view word) noexcept
+    -> std::uint64_t
+  {
+    auto state = seed;
+    auto i = 0u;
+    for (; i + 8u <= word.size (); i += 8u)
+      state = step (state, load_block (word.data () + i, 8u));
+    if (i < word.size ())
+      state = step (state, load_block (word.data () + i, word.size () - i));
+    return finish (state, word.size ());
+  }
+
+  static constexpr auto of_short (std::uint64_t lo, std::uint64_t hi, std::size_t length) noexcept
+    -> std::uint64_t
+  {
+    auto state = step (seed, lo);
+    if (length > 8u)
+      state = step (state, hi);
+    return finish (state, length);
+  }
+};
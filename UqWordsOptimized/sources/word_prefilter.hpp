@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Per-worker direct-mapped cache of recently inserted short words, small enough
+// to stay in L1/L2. A hit proves the word already went into some set of the
+// current run, so it can be dropped before probing the (much larger) reduce
+// target. Keys are compared exactly, there are no false positives, so unlike a
+// Bloom filter it is safe to skip on a hit.
+//
+// The hit rate is measured over windows of lookups, when it falls below the
+// threshold the cache is bypassed for a while and then probed again.
+struct alignas(64) word_prefilter
+{
+  static constexpr std::size_t num_entries = 2048u;
+  static constexpr std::size_t max_length = 16u;
+  static constexpr std::uint64_t window_size = 64u * 1024u;
+  static constexpr std::uint64_t bypass_size = 16u * window_size;
+  static constexpr std::uint64_t min_hits_per_window = window_size / 8u;
+
+  struct stats_type
+  {
+    std::uint64_t lookups  { 0u };
+    std::uint64_t hits     { 0u };
+    std::uint64_t bypassed { 0u };
+
+    auto operator += (const stats_type& other) noexcept -> stats_type&
+    {
+      lookups += other.lookups;
+      hits += other.hits;
+      bypassed += other.bypassed;
+      return *this;
+    }
+
+    auto hit_rate () const noexcept -> double
+    {
+      return lookups ? double (hits) / double (lookups) : 0.0;
+    }
+  };
+
+  // Returns true if the word is known to have been inserted already, the hash
+  // is the word_hash of the word, as carried by the fused tokenizer.
+  auto seen (std::string_view word, std::uint64_t hash) noexcept -> bool
+  {
+    if (m_bypass_left > 0u)
+    {
+      --m_bypass_left;
+      ++m_stats.bypassed;
+      return false;
+    }
+    if (word.size () > max_length || word.empty ())
+      return false;
+
+    char bytes [max_length] {};
+    std::memcpy (bytes, word.data (), word.size ());
+    entry_type the_entry { 0u, 0u, (hash & ~std::uint64_t { 0xffu }) | word.size () };
+    std::memcpy (&the_entry.lo, bytes, 8u);
+    std::memcpy (&the_entry.hi, bytes + 8u, 8u);
+
+    auto& current = m_entries [hash & (num_entries - 1u)];
+    const auto is_hit = current.tag == the_entry.tag && current.lo == the_entry.lo && current.hi == the_entry.hi;
+    if (!is_hit)
+      current = the_entry;
+
+    ++m_stats.lookups;
+    m_stats.hits += is_hit;
+    m_window_hits += is_hit;
+    if (++m_window_lookups == window_size)
+    {
+      if (m_window_hits < min_hits_per_window)
+        m_bypass_left = bypass_size;
+      m_window_lookups = 0u;
+      m_window_hits = 0u;
+    }
+    return is_hit;
+  }
+
+  // Must be called between runs, entries are only valid for the run that made them.
+  void reset () noexcept
+  {
+    m_entries.fill ({});
+    m_window_lookups = 0u;
+    m_window_hits = 0u;
+    m_bypass_left = 0u;
+    m_stats = {};
+  }
+
+  auto stats () const noexcept -> const stats_type&
+  {
+    return m_stats;
+  }
+
+private:
+  // Same layout as the short_word_set slots, the low byte of the tag holds
+  // the length so an empty entry never matches and the compare is exact.
+  struct entry_type
+  {
+    std::uint64_t lo  { 0u };
+    std::uint64_t hi  { 0u };
+    std::uint64_t tag { 0u };
+  };
+
+  std::array<entry_type, num_entries> m_entries {};
+  std::uint64_t                       m_window_lookups { 0u };
+  std::uint64_t                       m_window_hits { 0u };
+  std::uint64_t                       m_bypass_left { 0u };
+  stats_type                          m_stats;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <utility>
+#include <string_view>
+#include <type_traits>
+
+// Word stages sit between splitting a chunk and inserting into the reduce target,
+// each one is invoked as stage (word, emit) and calls emit zero or more times.
+
+struct pass_through_stage
+{
+  template <typename _Emit>
+  void operator () (std::string_view word, _Emit&& emit) const
+  {
+    emit (word);
+  }
+};
+
+template <typename _Predicate>
+struct filter_stage
+{
+  filter_stage (_Predicate predicate)
+  : m_predicate { std::move (predicate) }
+  {}
+
+  template <typename _Emit>
+  void operator () (std::string_view word, _Emit&& emit) const
+  {
+    if (m_predicate (word))
+      emit (word);
+  }
+
+private:
+  _Predicate m_predicate;
+};
+
+template <typename _Transform>
+struct transform_stage
+{
+  transform_stage (_Transform transform)
+  : m_transform { std::move (transform) }
+  {}
+
+  template <typename _Emit>
+  void operator () (std::string_view word, _Emit&& emit) const
+  {
+    emit (m_transform (word));
+  }
+
+private:
+  _Transform m_transform;
+};
+
+template <typename _First, typename _Second>
+struct chained_stage
+{
+  chained_stage (_First first, _Second second)
+  : m_first { std::move (first) },
+    m_second { std::move (second) }
+  {}
+
+  template <typename _Emit>
+  void operator () (std::string_view word, _Emit&& emit) const
+  {
+    m_first (word, [this, &emit] (auto&& word_out) {
+      m_second (std::string_view { word_out }, emit);
+    });
+  }
+
+private:
+  _First  m_first;
+  _Second m_second;
+};
+
+template <typename _First, typename _Second>
+auto chain_stages (_First first, _Second second)
+{
+  return chained_stage<_First, _Second> { std::move (first), std::move (second) };
+}
+
+template <typename _First, typename _Second, typename... _Rest>
+auto chain_stages (_First first, _Second second, _Rest... rest)
+{
+  return chain_stages (chain_stages (std::move (first), std::move (second)), std::move (rest)...);
+}
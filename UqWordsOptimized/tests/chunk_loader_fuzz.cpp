@@ -0,0 +1,157 @@
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include "chunk_loader.hpp"
+#include "word_hash.hpp"
+
+// Writes random layouts (long tokens, runs of delimiters, no trailing
+// delimiter, ...) to a file and checks that chunk_loader gives back the words
+// of a plain split of the whole buffer : next () in order, load_at () tiling
+// in any order, and for_each_hashed_word with the word_hash of every word.
+
+using word_list = std::vector<std::pair<std::string, std::uint64_t>>;
+
+auto random_layout(std::mt19937_64& random, std::size_t max_size)
+  -> std::string
+{
+  const auto target_size = std::uniform_int_distribution<std::size_t> { 0u, max_size } (random);
+  std::string the_layout;
+  while (the_layout.size() < target_size)
+  {
+    switch (random() % 8u)
+    {
+    case 0u:
+      // Runs of delimiters.
+      the_layout.append(1u + random() % 64u, ' ');
+      break;
+    case 1u:
+      // Tokens much longer than small chunks.
+      the_layout.append(1u + random() % (max_size / 2u), char('a' + random() % 26u));
+      break;
+    case 2u:
+      // Bytes with the high bit set, they go through the hash as well.
+      for (auto i = 1u + random() % 12u; i > 0u; --i)
+        the_layout.push_back(char(0x80u + random() % 0x7fu));
+      the_layout.push_back(' ');
+      break;
+    default:
+      for (auto i = 1u + random() % 20u; i > 0u; --i)
+        the_layout.push_back(char('a' + random() % 4u));
+      the_layout.push_back(' ');
+      break;
+    }
+  }
+  the_layout.resize(target_size);
+  // Half of the layouts end without a delimiter.
+  if (!the_layout.empty() && random() % 2u)
+    the_layout.back() = 'z';
+  return the_layout;
+}
+
+auto reference_split(std::string_view text)
+  -> word_list
+{
+  word_list the_words;
+  auto start_here = text.find_first_not_of(' ');
+  while (start_here != std::string_view::npos)
+  {
+    const auto end_here = text.find(' ', start_here);
+    const auto word = text.substr(start_here, end_here - start_here);
+    the_words.emplace_back(std::string { word }, word_hash::of(word));
+    start_here = text.find_first_not_of(' ', end_here);
+  }
+  return the_words;
+}
+
+// Both of the tokenizers of a chunk, appended to their own list.
+void split_chunk(const chunk_loader::chunk_type& the_chunk, word_list& the_words, word_list& the_hashed_words)
+{
+  the_chunk.for_each_word([&] (std::string_view word) {
+    the_words.emplace_back(std::string { word }, word_hash::of(word));
+  }, ' ');
+  the_chunk.for_each_hashed_word([&] (std::string_view word, std::uint64_t hash) {
+    the_hashed_words.emplace_back(std::string { word }, hash);
+  }, ' ');
+}
+
+auto check_layout(const std::filesystem::path& file_path, std::string_view the_layout, std::size_t chunk_size, std::mt19937_64& random)
+  -> std::string
+{
+  const auto expected = reference_split(the_layout);
+
+  word_list in_order, in_order_hashed;
+  chunk_loader sequential { file_path, chunk_size };
+  while (auto the_chunk = sequential.next(' '))
+    split_chunk(*the_chunk, in_order, in_order_hashed);
+  if (in_order != expected)
+    return "next () words differ";
+  if (in_order_hashed != expected)
+    return "next () for_each_hashed_word differs";
+
+  std::vector<std::uint64_t> offsets;
+  for (std::uint64_t offset = 0u; offset < the_layout.size(); offset += chunk_size)
+    offsets.push_back(offset);
+  std::shuffle(offsets.begin(), offsets.end(), random);
+
+  word_list tiled, tiled_hashed;
+  chunk_loader random_access { file_path, chunk_size };
+  for (const auto offset : offsets)
+    if (auto the_chunk = random_access.load_at(offset, ' '))
+      split_chunk(*the_chunk, tiled, tiled_hashed);
+  if (random_access.load_at(the_layout.size(), ' '))
+    return "load_at () past the end gave a chunk";
+
+  auto sorted_expected = expected;
+  std::sort(sorted_expected.begin(), sorted_expected.end());
+  std::sort(tiled.begin(), tiled.end());
+  std::sort(tiled_hashed.begin(), tiled_hashed.end());
+  if (tiled != sorted_expected)
+    return "load_at () tiling words differ";
+  if (tiled_hashed != sorted_expected)
+    return "load_at () tiling for_each_hashed_word differs";
+  return {};
+}
+
+int main(int argc, char** argv)
+{
+  using namespace std;
+
+  const auto num_cases = argc > 1 ? std::stoul(argv[1]) : 1500ul;
+  const auto seed = argc > 2 ? std::stoull(argv[2]) : 1ull;
+  const auto file_path = filesystem::temp_directory_path() / fmt::format("chunk_loader_fuzz_{}.txt", ::getpid());
+
+  mt19937_64 random { seed };
+  auto num_failures = 0u;
+  for (auto i = 0ul; i < num_cases; ++i)
+  {
+    // Mostly tiny chunks, where every edge case is hit many times per layout,
+    // on shorter layouts since each chunk is a mapping of its own.
+    const auto is_tiny = random() % 4u != 0u;
+    const auto chunk_size = is_tiny
+      ? 1u + random() % 64u
+      : 1u + random() % (12u * 1024u);
+    const auto the_layout = random_layout(random, is_tiny ? 4000u : 40000u);
+    {
+      ofstream the_file { file_path, ios::binary | ios::trunc };
+      the_file.write(the_layout.data(), the_layout.size());
+    }
+    if (const auto failure = check_layout(file_path, the_layout, chunk_size, random); !failure.empty())
+    {
+      cout << fmt::format("case {} (seed {}, {} bytes, chunk size {}) : {}\n", i, seed, the_layout.size(), chunk_size, failure);
+      ++num_failures;
+    }
+  }
+  filesystem::remove(file_path);
+
+  cout << fmt::format("{} of {} cases passed\n", num_cases - num_failures, num_cases);
+  return num_failures == 0u ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+#include <map>
+#include <random>
+#include <string>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <iostream>
+#include <filesystem>
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include "parallel_split_and_reduce.hpp"
+#include "short_word_set.hpp"
+#include "hashed_word_set.hpp"
+#include "word_count_map.hpp"
+#include "word_stages.hpp"
+
+// Runs apply_to_file_at_path_async with chained word stages (filter, transform
+// and a stage emitting several words) on random text and checks the result
+// against the same steps applied by hand to a plain split of the whole buffer.
+
+using word_counts = std::map<std::string, std::uint64_t>;
+
+auto random_text(std::mt19937_64& random, std::size_t num_words)
+  -> std::string
+{
+  std::string the_text;
+  for (auto i = 0u; i < num_words; ++i)
+  {
+    for (auto length = 1u + random() % 10u; length > 0u; --length)
+      the_text.push_back(random() % 8u == 0u ? '-' : char('a' + random() % 6u));
+    the_text.append(1u + random() % 3u, ' ');
+  }
+  return the_text;
+}
+
+// Drops words of one or two bytes, folds 'f' into 'e', then splits on '-'.
+auto make_stages()
+{
+  auto is_long_enough = [] (std::string_view word) { return word.size() > 2u; };
+  auto fold = [] (std::string_view word) {
+    std::string the_word { word };
+    for (auto& c : the_word)
+      c = c == 'f' ? 'e' : c;
+    return the_word;
+  };
+  auto split_dashes = [] (std::string_view word, auto&& emit) {
+    for (auto start_here = word.find_first_not_of('-'); start_here != std::string_view::npos; )
+    {
+      const auto end_here = word.find('-', start_here);
+      emit(word.substr(start_here, end_here - start_here));
+      start_here = word.find_first_not_of('-', end_here);
+    }
+  };
+  return chain_stages(filter_stage { is_long_enough }, transform_stage { fold }, split_dashes);
+}
+
+// The same steps written out by hand over a plain split of the whole buffer.
+auto reference_counts(std::string_view text)
+  -> word_counts
+{
+  word_counts the_counts;
+  std::string the_word;
+  for (auto start_here = text.find_first_not_of(' '); start_here != std::string_view::npos; )
+  {
+    const auto end_here = text.find(' ', start_here);
+    the_word = text.substr(start_here, end_here - start_here);
+    start_here = text.find_first_not_of(' ', end_here);
+    if (the_word.size() <= 2u)
+      continue;
+    std::replace(the_word.begin(), the_word.end(), 'f', 'e');
+    std::replace(the_word.begin(), the_word.end(), '-', ' ');
+    std::istringstream the_parts { the_word };
+    for (std::string the_part; the_parts >> the_part; )
+      ++the_counts[the_part];
+  }
+  return the_counts;
+}
+
+template <typename _Reduce_target>
+auto count_with_stages(const std::filesystem::path& file_path, std::uint32_t num_threads, std::size_t chunk_size)
+  -> _Reduce_target
+{
+  parallel_split_and_reduce<_Reduce_target> the_counter { num_threads, 4u };
+  return sync_wait(the_counter.apply_to_file_at_path_async(file_path, chunk_size, make_stages()));
+}
+
+auto check_file(const std::filesystem::path& file_path, const word_counts& expected, std::uint32_t num_threads, std::size_t chunk_size)
+  -> std::string
+{
+  if (const auto the_size = count_with_stages<short_word_set>(file_path, num_threads, chunk_size).size(); the_size != expected.size())
+    return fmt::format("short_word_set has {} words, expected {}", the_size, expected.size());
+  if (const auto the_size = count_with_stages<hashed_word_set>(file_path, num_threads, chunk_size).size(); the_size != expected.size())
+    return fmt::format("hashed_word_set has {} words, expected {}", the_size, expected.size());
+
+  word_counts the_counts;
+  count_with_stages<word_count_map>(file_path, num_threads, chunk_size).for_each([&the_counts] (std::string_view word, std::uint64_t count) {
+    the_counts[std::string { word }] = count;
+  });
+  if (the_counts != expected)
+    return "word_count_map counts differ";
+  return {};
+}
+
+int main(int argc, char** argv)
+{
+  using namespace std;
+
+  const auto num_cases = argc > 1 ? std::stoul(argv[1]) : 24ul;
+  const auto seed = argc > 2 ? std::stoull(argv[2]) : 1ull;
+  const auto file_path = filesystem::temp_directory_path() / fmt::format("word_stages_test_{}.txt", ::getpid());
+
+  mt19937_64 random { seed };
+  auto num_failures = 0u;
+  for (auto i = 0ul; i < num_cases; ++i)
+  {
+    const auto the_text = random_text(random, 1u + random() % 20000u);
+    {
+      ofstream the_file { file_path, ios::binary | ios::trunc };
+      the_file.write(the_text.data(), the_text.size());
+    }
+    const auto num_threads = 1u + uint32_t (random() % 4u);
+    const auto chunk_size = mmap_wrapper::alignment_size() * (1u + random() % 16u);
+    if (const auto failure = check_file(file_path, reference_counts(the_text), num_threads, chunk_size); !failure.empty())
+    {
+      cout << fmt::format("case {} (seed {}, {} bytes, {} threads, chunk size {}) : {}\n", i, seed, the_text.size(), num_threads, chunk_size, failure);
+      ++num_failures;
+    }
+  }
+  filesystem::remove(file_path);
+
+  cout << fmt::format("{} of {} cases passed\n", num_cases - num_failures, num_cases);
+  return num_failures == 0u ? 0 : 1;
+}